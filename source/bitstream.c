@@ -0,0 +1,224 @@
+/***************************************************************************
+*    Contributed to VESA for inclusion and use in its VESA Display Stream
+*    Compression reference model.  This file extends the Broadcom
+*    contribution and is distributed under the same terms and conditions
+*    as the rest of the model.
+***************************************************************************/
+
+/*! \file bitstream.c
+ *    Bitstream buffer reader and writer */
+
+#include <stdio.h>
+#include <string.h>
+#include "bitstream.h"
+
+//! Count leading zeros of a 32-bit value
+/*! \param x         Value (must be nonzero)
+	\return          Number of leading 0 bits */
+int clz32(unsigned int x)
+{
+#if defined(__GNUC__)
+	return __builtin_clz(x);
+#else
+	int n = 0;
+	while (!(x & 0x80000000u)) { x <<= 1; n++; }
+	return n;
+#endif
+}
+
+
+//! Count trailing zeros of a 32-bit value
+/*! \param x         Value (must be nonzero)
+	\return          Number of trailing 0 bits */
+int ctz32(unsigned int x)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(x);
+#else
+	int n = 0;
+	while (!(x & 1)) { x >>= 1; n++; }
+	return n;
+#endif
+}
+
+
+//! Count leading zeros of a 64-bit value
+/*! \param x         Value (must be nonzero)
+	\return          Number of leading 0 bits */
+int clz64(unsigned long long x)
+{
+#if defined(__GNUC__)
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+	while (!(x & 0x8000000000000000ull)) { x <<= 1; n++; }
+	return n;
+#endif
+}
+
+
+//! Initialize a bit writer
+/*! \param bw        Bit writer
+	\param buf       Output buffer */
+void bitwriter_init(bitwriter_t *bw, unsigned char *buf)
+{
+	bw->buf = buf;
+	bw->acc = 0;
+	bw->acc_bits = 0;
+}
+
+
+//! Write bits to the output buffer
+/*! Completed bytes are stored immediately; a trailing partial byte stays in the
+    accumulator until more bits arrive or bitwriter_flush() is called.
+	\param bw        Bit writer
+	\param val       Value to write (LSB-justified)
+	\param size      Number of bits to write (0-32)
+	\param bit_count Number of bits written so far (modified) */
+void bitwriter_put_bits(bitwriter_t *bw, unsigned int val, int size, int *bit_count)
+{
+	unsigned char *p;
+
+	if(size>32)
+		printf("error: bitwriter_put_bits supports max of 32 bits\n");
+	if(size<=0)
+		return;
+	p = bw->buf + ((*bit_count)>>3);
+	bw->acc = (bw->acc << size) | (val & ((1ULL << size) - 1));
+	bw->acc_bits += size;
+	*bit_count += size;
+	while(bw->acc_bits >= 8)
+	{
+		bw->acc_bits -= 8;
+		*(p++) = (unsigned char)(bw->acc >> bw->acc_bits);
+	}
+}
+
+
+//! Write a run of whole bytes to the output buffer
+/*! \param bw        Bit writer
+	\param data      Bytes to write
+	\param nbytes    Number of bytes
+	\param bit_count Number of bits written so far (modified) */
+void bitwriter_put_bytes(bitwriter_t *bw, const unsigned char *data, int nbytes, int *bit_count)
+{
+	int i;
+
+	if(bw->acc_bits == 0)   // Byte-aligned
+	{
+		memcpy(bw->buf + ((*bit_count)>>3), data, nbytes);
+		*bit_count += nbytes * 8;
+	}
+	else
+	{
+		for(i=0; i<nbytes; ++i)
+			bitwriter_put_bits(bw, data[i], 8, bit_count);
+	}
+}
+
+
+//! Write out any partial byte left in the accumulator (padded with 0's)
+/*! \param bw        Bit writer
+	\param bit_count Number of bits written so far */
+void bitwriter_flush(bitwriter_t *bw, int bit_count)
+{
+	if(bw->acc_bits > 0)
+		bw->buf[bit_count>>3] = (unsigned char)(bw->acc << (8 - bw->acc_bits));
+}
+
+
+//! Initialize a bit reader
+/*! \param br        Bit reader
+	\param buf       Input buffer
+	\param size      Size of input buffer in bytes */
+void bitreader_init(bitreader_t *br, const unsigned char *buf, int size)
+{
+	br->buf = buf;
+	br->size = size;
+	br->byte_pos = 0;
+	br->cache = 0;
+	br->cache_bits = 0;
+}
+
+
+//! Top up the lookahead window to at least 57 bits
+/*! \param br        Bit reader */
+static void bitreader_refill(bitreader_t *br)
+{
+	unsigned long long b;
+
+	while (br->cache_bits <= 56)
+	{
+		b = (br->byte_pos < br->size) ? br->buf[br->byte_pos] : 0;
+		br->cache |= b << (56 - br->cache_bits);
+		br->cache_bits += 8;
+		br->byte_pos++;
+	}
+}
+
+
+//! Read bits from the input buffer
+/*! \param br        Bit reader
+	\param nbits     Number of bits to read (0-32)
+	\param sign_extend Flag indicating to do a sign extension on the result
+	\param bit_count Number of bits read so far (modified)
+	\return          Value from bitstream */
+int bitreader_get_bits(bitreader_t *br, int nbits, int sign_extend, int *bit_count)
+{
+	unsigned int d;
+
+	if (nbits <= 0)
+		return (0);
+	if (br->cache_bits < nbits)
+		bitreader_refill(br);
+	d = (unsigned int)(br->cache >> (64 - nbits));
+	br->cache <<= nbits;
+	br->cache_bits -= nbits;
+	*bit_count += nbits;
+	if (sign_extend && (d >> (nbits - 1)))
+		d |= ~((1u << (nbits - 1) << 1) - 1);
+	return (d);
+}
+
+
+//! Read a unary prefix (0's terminated by a 1) from the input buffer
+/*! Equivalent to reading one bit at a time until a 1 is read or max_prefix 0's
+    have been read.  The terminating 1 (if any) is consumed.
+	\param br        Bit reader
+	\param max_prefix Maximum prefix value
+	\param bit_count Number of bits read so far (modified)
+	\return          Number of leading 0's */
+int bitreader_get_prefix(bitreader_t *br, int max_prefix, int *bit_count)
+{
+	int prefix = 0;
+	int zeros;
+
+	while (prefix < max_prefix)
+	{
+		if (br->cache_bits < 32)
+			bitreader_refill(br);
+		zeros = br->cache ? clz64(br->cache) : 64;
+		if (zeros > br->cache_bits)
+			zeros = br->cache_bits;
+		if (prefix + zeros >= max_prefix)
+		{
+			zeros = max_prefix - prefix;
+			br->cache <<= zeros;
+			br->cache_bits -= zeros;
+			*bit_count += zeros;
+			return (max_prefix);
+		}
+		if (zeros < br->cache_bits)   // Found the terminating 1
+		{
+			br->cache = (br->cache << zeros) << 1;
+			br->cache_bits -= zeros + 1;
+			*bit_count += zeros + 1;
+			return (prefix + zeros);
+		}
+		br->cache = 0;
+		br->cache_bits = 0;
+		*bit_count += zeros;
+		prefix += zeros;
+	}
+	return (prefix);
+}
@@ -0,0 +1,45 @@
+/***************************************************************************
+*    Contributed to VESA for inclusion and use in its VESA Display Stream
+*    Compression reference model.  This file extends the Broadcom
+*    contribution and is distributed under the same terms and conditions
+*    as the rest of the model.
+***************************************************************************/
+
+/*! \file bitstream.h
+ *    Bitstream buffer reader and writer */
+
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+/// Writes MSB-first bits to a byte buffer through a 64-bit accumulator
+typedef struct bitwriter_s
+{
+	unsigned char *buf;        ///< Output buffer
+	unsigned long long acc;    ///< Accumulator, pending bits are in the LSB's
+	int acc_bits;              ///< Number of pending bits in the accumulator (always < 8 between calls)
+} bitwriter_t;
+
+void bitwriter_init(bitwriter_t *bw, unsigned char *buf);
+void bitwriter_put_bits(bitwriter_t *bw, unsigned int val, int size, int *bit_count);
+void bitwriter_put_bytes(bitwriter_t *bw, const unsigned char *data, int nbytes, int *bit_count);
+void bitwriter_flush(bitwriter_t *bw, int bit_count);
+
+/// Reads MSB-first bits from a byte buffer through a 64-bit lookahead window
+typedef struct bitreader_s
+{
+	const unsigned char *buf;  ///< Input buffer
+	int size;                  ///< Size of input buffer in bytes (reads past the end return 0's)
+	int byte_pos;              ///< Next byte to load into the window
+	unsigned long long cache;  ///< Lookahead window, next bit is the MSB
+	int cache_bits;            ///< Number of valid bits in the window
+} bitreader_t;
+
+void bitreader_init(bitreader_t *br, const unsigned char *buf, int size);
+int bitreader_get_bits(bitreader_t *br, int nbits, int sign_extend, int *bit_count);
+int bitreader_get_prefix(bitreader_t *br, int max_prefix, int *bit_count);
+
+int clz32(unsigned int x);
+int ctz32(unsigned int x);
+int clz64(unsigned long long x);
+
+#endif
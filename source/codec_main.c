@@ -59,7 +59,9 @@
 #include "psnr.h"
 #include "cmd_parse.h"
 #include "dsc_codec.h"
+#include "libdsc.h"
 #include "logging.h"
+#include "threadpool.h"
 
 #define PATH_MAX 1024
 #define MAX_OPTNAME_LEN 200
@@ -102,12 +104,14 @@ static int rbSwapOut;
 static int dpxBugsOverride;
 static int dpxPadLineEnds;
 static int dpxWriteBSwap;
+static int dpxMmapOutput;
 static int flatnessMinQp;
 static int flatnessMaxQp;
 static int flatnessDetThresh;
 static int enableVbr;
 static int muxingMode;
 static int muxWordSize;
+static int numThreads;
 static  cmdarg_t cmd_args[] = {
 
 	// The array arguments have to be first:
@@ -134,6 +138,7 @@ static  cmdarg_t cmd_args[] = {
 	{ IARG,  &dpxBugsOverride,    "DPX_BUGS_OVERRIDE",    "-dpxbugs", 0, 0},  // Sets the DPX bugs mode (else autodetect)
 	{ PARG,  &dpxPadLineEnds,     "DPX_PAD_LINE_ENDS",    "-dpxpad",  0, 0},  // Pad line ends for DPX output
 	{ PARG,  &dpxWriteBSwap,      "DPX_WRITE_BSWAP",      "-dpxwbs",  0, 0},  // Pad line ends for DPX output
+	{ PARG,  &dpxMmapOutput,      "DPX_MMAP_OUTPUT",      "-dpxmmap", 0, 0},  // Write DPX output through a memory-mapped file
 	{ PARG,  &enableVbr,          "VBR_ENABLE",           "-vbr",  0,  0},    // 1=disable stuffing bits (on/off VBR)
 	{ PARG,  &muxWordSize,        "MUX_WORD_SIZE",        "-mws",  0,  0},    // mux word size if SSM enabled
 
@@ -146,6 +151,7 @@ static  cmdarg_t cmd_args[] = {
 	{ PARG,  &flatnessMaxQp,      "FLATNESS_MAX_QP",       "-fmax", 0,  0},   // Flatness max QP
 	{ PARG,  &flatnessDetThresh,  "FLATNESS_DET_THRESH",  "-fdt",  0,  0},   // Flatness detect threshold
 	{ PARG,  &muxingMode,         "MUXING_MODE",          "-mm",   0,  0},   // Multiplexing mode
+	{ PARG,  &numThreads,         "NUM_THREADS",          "-threads", 0, 0},  // Number of slices to code in parallel
      {NARG,  &help,               "",                     "-help"   , 0, 0}, // video format
      {SARG,   filepath,           "INCLUDE",              "-F"      , 0, 0}, // Cconfig file
      {SARG,   option,             "",                     "-O"      , 0, 0}, // key/value pair
@@ -189,8 +195,10 @@ void set_defaults(void)
 	dpxBugsOverride = -1;
 	dpxPadLineEnds = 0;
 	dpxWriteBSwap = 0;
+	dpxMmapOutput = 0;
 	enableVbr = 0;
 	muxingMode = 1;
+	numThreads = 1;
 
 	tgtOffsetHi = 3;
 	tgtOffsetLo = 3;
@@ -438,11 +446,24 @@ void write_dsc_data(unsigned char **bit_buffer, int nbytes, FILE *fp, int vbr_en
 	int i;
 	int slice_x, slice_y;
 	int *current_idx;
+	size_t total = 0, pos = 0;
+	unsigned char *stream;
 
 	current_idx = (int *)malloc(sizeof(int) * slices_per_line);
 	for (i=0; i<slices_per_line; ++i)
 		current_idx[i] = 0;
 
+	// Interleave the chunks of the slice row in memory and write them at once
+	for (slice_y = 0; slice_y < slice_height; ++slice_y)
+		for (slice_x = 0; slice_x < slices_per_line; ++slice_x)
+			total += vbr_enable ? 2 + sizes[slice_x][slice_y] : nbytes;
+	stream = (unsigned char *)malloc(MAX(total, 1));
+	if ((current_idx == NULL) || (stream == NULL))
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
+
 	for (slice_y = 0; slice_y < slice_height; ++slice_y)
 	{
 		for (slice_x = 0; slice_x < slices_per_line; ++slice_x)
@@ -450,14 +471,16 @@ void write_dsc_data(unsigned char **bit_buffer, int nbytes, FILE *fp, int vbr_en
 			if (vbr_enable)
 			{
 				nbytes = sizes[slice_x][slice_y];
-				fputc((nbytes>>8) & 0xff, fp);
-				fputc(nbytes & 0xff, fp);
+				stream[pos++] = (nbytes>>8) & 0xff;
+				stream[pos++] = nbytes & 0xff;
 			}
-			for (i=0; i<nbytes; ++i)
-				fputc(bit_buffer[slice_x][current_idx[slice_x] + i], fp);
+			memcpy(stream + pos, bit_buffer[slice_x] + current_idx[slice_x], nbytes);
+			pos += nbytes;
 			current_idx[slice_x] += nbytes;
 		}
 	}
+	fwrite(stream, 1, pos, fp);
+	free(stream);
 	free(current_idx);
 }
 
@@ -484,34 +507,142 @@ int read_dsc_data(unsigned char **bit_buffer, int nbytes, FILE *fp, int vbr_enab
 {
 	int i, slice_y, slice_x;
 	int *current_idx, total_bytes = 0;
+	size_t total, pos = 0, n;
+	unsigned char *stream = NULL;
+	unsigned char size_bytes[2];
 
 	current_idx = (int *)malloc(sizeof(int) * slices_per_line);
 	for (i=0; i<slices_per_line; ++i)
 		current_idx[i] = 0;
 
+	// The CBR slice row has a known size: read it at once and scatter the chunks
+	if (!vbr_enable)
+	{
+		total = (size_t)nbytes * slices_per_line * slice_height;
+		stream = (unsigned char *)malloc(MAX(total, 1));
+		if (stream == NULL)
+		{
+			fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+			exit(1);
+		}
+		n = fread(stream, 1, total, fp);
+		if (n < total)
+			memset(stream + n, 0xff, total - n);   // Past the end of file, as fgetc() EOF & 0xff
+	}
+
 	for (slice_y = 0; slice_y < slice_height; ++slice_y)
 	{
 		for (slice_x = 0; slice_x < slices_per_line; ++slice_x)
 		{
 			if (vbr_enable)
 			{
-				nbytes = 0;
-				for(i=0; i<2; ++i)
-					nbytes = (nbytes<<8) | (fgetc(fp) & 0xff);
+				// Each chunk is preceded by its size; read it straight into the slice buffer
+				n = fread(size_bytes, 1, 2, fp);
+				if (n < 2)
+					memset(size_bytes + n, 0xff, 2 - n);
+				nbytes = (size_bytes[0] << 8) | size_bytes[1];
+				n = fread(bit_buffer[slice_x] + current_idx[slice_x], 1, nbytes, fp);
+				if (n < (size_t)nbytes)
+					memset(bit_buffer[slice_x] + current_idx[slice_x] + n, 0xff, nbytes - n);
+			}
+			else
+			{
+				memcpy(bit_buffer[slice_x] + current_idx[slice_x], stream + pos, nbytes);
+				pos += nbytes;
 			}
-			for(i=0; i<nbytes; ++i)
-				bit_buffer[slice_x][i+current_idx[slice_x]] = fgetc(fp) & 0xff;
 			current_idx[slice_x] += nbytes;
 			total_bytes += nbytes;
 		}
 	}
 
+	free(stream);
 	free(current_idx);
 	return(total_bytes);
 }
 
 
 
+//! Free the per-slice bitstream buffers and chunk size arrays
+/*! \param buf       Bitstream buffer for each slice (may be NULL)
+	\param chunk_sizes Chunk sizes for each slice (may be NULL)
+	\param numslices Number of slices the arrays were allocated for */
+static void free_slice_buffers(unsigned char **buf, int **chunk_sizes, int numslices)
+{
+	int i;
+
+	for (i=0; i<numslices; ++i)
+	{
+		free(buf[i]);
+		free(chunk_sizes[i]);
+	}
+	free(buf);
+	free(chunk_sizes);
+}
+
+
+//! State shared by the slice jobs of one picture
+typedef struct slice_jobs_s
+{
+	dsc_cfg_t *dsc_cfg;        // Picture-level configuration
+	dsc_context_t **dsc_ctx;   // Codec context of each worker thread
+	pic_t *ip;                 // Input picture
+	pic_t *op;                 // Output picture
+	unsigned char **buf;       // Bitstream buffer for each slice (raster order)
+	int **chunk_sizes;         // Chunk sizes for each slice (raster order)
+	int slices_per_line;       // Number of slices across the picture
+	int numslices;             // Total number of slices
+} slice_jobs_t;
+
+
+/*!
+ ************************************************************************
+ * \brief
+ *    code_slice() - Encode and/or decode one slice
+ *
+ * \param ctx
+ *    Pointer to slice_jobs_t for the current picture
+ * \param worker
+ *    Index of the worker thread (selects its codec context)
+ * \param idx
+ *    Slice index in raster order
+ *
+ * Each worker codes its slices with its own codec context, so slices may be
+ * coded concurrently.  Slices only write their own region of the output picture.  Progress is only
+ * printed here when running serially; otherwise the main thread reports it.
+ ************************************************************************
+ */
+static void code_slice(void *ctx, int worker, int idx)
+{
+	slice_jobs_t *jobs = (slice_jobs_t *)ctx;
+	dsc_context_t *dsc_ctx = jobs->dsc_ctx[worker];
+	int xstart, ystart;
+	int num_bits;
+	int err = DSC_OK;
+
+	xstart = (idx % jobs->slices_per_line) * jobs->dsc_cfg->slice_width;
+	ystart = (idx / jobs->slices_per_line) * jobs->dsc_cfg->slice_height;
+	if (numThreads <= 1)
+	{
+		printf("Processing slice %d / %d\r", idx+1, jobs->numslices);
+		fflush(stdout);  // For Bob.
+	}
+
+	// Encoder
+	if ((function==0) || (function==1))
+		err = dsc_encode_slice(dsc_ctx, xstart, ystart, jobs->ip, jobs->op, jobs->buf[idx], jobs->chunk_sizes[idx], &num_bits);
+
+	// Decoder
+	if ((err == DSC_OK) && ((function==0) || (function == 2)))
+		err = dsc_decode_slice(dsc_ctx, xstart, ystart, jobs->op, jobs->buf[idx]);
+
+	if (err != DSC_OK)
+	{
+		fprintf(stderr, "ERROR: Slice %d: %s\n", idx, dsc_error_string(err));
+		exit(1);
+	}
+}
+
+
 /*!
  ************************************************************************
  * \brief
@@ -531,27 +662,31 @@ int main(int argc, char *argv[])
 {
 	pic_t *ip=NULL, *ip2, *ref_pic, *op_dsc;
 	dsc_cfg_t dsc_codec;
-	unsigned char **buf;
+	unsigned char **buf = NULL;
+	int buf_slices = 0, buf_size = 0, buf_rows = 0;   // Allocated slice buffers (reused while large enough)
 	char f[PATH_MAX], infname[PATH_MAX], bitsfname[PATH_MAX];
 	char *extension;
 	FILE *list_fp, *logfp;
 	char base_name[PATH_MAX];
-	int i, j;
+	int i;
 	FILE *bits_fp = NULL;
 	int fcnt;
 	int bufsize;
-	int xs, ys;
 	int slicew, sliceh;
 	int target_bpp_x16;
-	pic_t **temp_pic = NULL;
-	int numslices, slicecount;
+	int numslices;
+	slice_jobs_t slice_jobs;
+	dsc_context_t **dsc_ctx = NULL;   // One codec context per worker thread (kept across pictures)
+	dsc_cfg_t ctx_cfg;                // Configuration the contexts were last set up with
+	int num_ctx = 0, err;
+	thread_pool_t *workers;           // Slice coding threads (kept across pictures)
 	int final_scale, num_extra_mux_bits;
 	int hrdDelay, groupsPerLine, rbsMin;
 	int final_value;
 	int slices_per_line;
 	int groups_total;
 	int useppm = 0;
-	int **chunk_sizes;
+	int **chunk_sizes = NULL;
 	int sliceBits;
 	int prev_min_qp, prev_max_qp, prev_thresh, prev_offset;
 	unsigned char pps[PPS_SIZE];
@@ -571,6 +706,9 @@ int main(int argc, char *argv[])
 	/* process input arguments */
     process_args(argc, argv, cmd_args);
 
+	// Worker threads are started once and reused for every picture in the list
+	workers = pool_create(numThreads);
+
 	if (NULL == (list_fp=fopen(fn_i, "rt")))
 	{
 		fprintf(stderr, "Cannot open list file %s for input\n", fn_i);
@@ -589,6 +727,10 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	// Pictures of the same size are reused from one list entry to the next
+	ppool_init(8);
+	set_dpx_mmap_output(dpxMmapOutput);
+
 	fcnt = 0;
 	infname[0] = '\0';
 	fgets(infname, 512, list_fp);
@@ -649,75 +791,23 @@ int main(int argc, char *argv[])
 			exit(1);
 		}
 
+		// R/B swap, bit depth, color space and chroma format conversion in one pass
 		if (ip)
 		{
-			ip->alpha = 0;
-
-			// R/B swap
-			if (rbSwap && (ip->color == RGB))
+			pnorm_t norm;
+
+			norm.rb_swap = rbSwap;
+			norm.bits = bitsPerComponent;
+			norm.yuv = useYuvInput;
+			norm.chroma = enable422 ? YUV_422 : YUV_444;
+			norm.w = ip->w;
+			norm.planes16 = 1;   // DSC samples have at most 12 bits, so half the memory of int planes
+			if (enable422 && (ip->w%2))
 			{
-				for (i=0; i<ip->h; ++i)
-					for (j=0; j<ip->w; ++j)
-					{
-						int tmp;
-						tmp = ip->data.rgb.r[i][j];
-						ip->data.rgb.r[i][j] = ip->data.rgb.b[i][j];
-						ip->data.rgb.b[i][j] = tmp;
-					}
+				norm.w--;
+				printf("WARNING: 4:2:2 picture width is constrained to be a multiple of 2.\nThe image %s will be cropped to %d pixels wide.\n", base_name, norm.w);
 			}
-
-			if (bitsPerComponent > ip->bits)
-				convertbits(ip, bitsPerComponent);
-		}
-
-		// 4:2:2 to 4:4:4 coversion
-		if (ip && (ip->chroma == YUV_422) && !enable422)
-		{
-			ip2 = pcreate(FRAME, ip->color, YUV_444, ip->w, ip->h);
-			ip2->bits = ip->bits;
-			ip2->alpha = 0;
-			yuv_422_444(ip, ip2);
-			pdestroy(ip);
-			ip = ip2;
-		}
-
-		// RGB to YUV conversion
-		if (ip && (ip->color == RGB) && useYuvInput)
-		{
-			ip2 = pcreate(FRAME, YUV_HD, ip->chroma, ip->w, ip->h);
-			ip2->bits = ip->bits;
-			ip2->alpha = 0;
-			rgb2yuv(ip, ip2);
-			pdestroy(ip);
-			ip = ip2;
-		}
-		else if (ip && ((ip->color == YUV_HD) || (ip->color == YUV_SD)) && !useYuvInput)      // YUV to RGB conversion
-		{
-			ip2 = pcreate(FRAME, RGB, YUV_444, ip->w, ip->h);
-			ip2->bits = ip->bits;
-			ip2->alpha = 0;
-			yuv2rgb(ip, ip2);
-			pdestroy(ip);
-			ip = ip2;
-		}
-
-		if (ip && (ip->chroma == YUV_444) && enable422)
-		{
-			ip2 = pcreate(FRAME, ip->color, YUV_422, ip->w, ip->h);
-			ip2->bits = ip->bits;
-			ip2->alpha = 0;
-			yuv_444_422(ip, ip2);
-			pdestroy(ip);
-			ip = ip2;
-		}
-
-		if (ip && (bitsPerComponent < ip->bits))
-			convertbits(ip, bitsPerComponent);
-
-		if (ip && enable422 && (ip->w%2))
-		{
-			ip->w--;
-			printf("WARNING: 4:2:2 picture width is constrained to be a multiple of 2.\nThe image %s will be cropped to %d pixels wide.\n", base_name, ip->w);
+			ip = pnormalize(ip, &norm, enable422 ? &ip2 : NULL);
 		}
 
 		if (ip && enable422 && (sliceWidth%2))
@@ -728,13 +818,7 @@ int main(int argc, char *argv[])
 
 		ref_pic = ip;
 		if (ip && enable422)
-		{
-			ip2 = pcreate(FRAME, ip->color, YUV_444, ip->w, ip->h);
-			ip2->bits = ip->bits;
-			ip2->alpha = 0;
-			simple422to444(ip, ip2);
-			ip = ip2;
-		}
+			ip = ip2;     // 4:4:4 copy made by pnormalize()
 
 		// Constants:
 		dsc_codec.muxing_mode = muxingMode;
@@ -762,6 +846,7 @@ int main(int argc, char *argv[])
 			if (muxWordSize==0)
 				muxWordSize = (dsc_codec.bits_per_component==12) ? 64 : 48;
 			dsc_codec.mux_word_size = muxWordSize;
+			RANGE_CHECK("mux_word_size", dsc_codec.mux_word_size, 8, MAX_MUX_WORD_SIZE);
 			dsc_codec.convert_rgb = !useYuvInput;
 			dsc_codec.rc_tgt_offset_hi = tgtOffsetHi;
 			RANGE_CHECK("rc_tgt_offset_hi", dsc_codec.rc_tgt_offset_hi, 0, 15);
@@ -965,78 +1050,81 @@ int main(int argc, char *argv[])
 			if (muxWordSize==0)
 				muxWordSize = (dsc_codec.bits_per_component==12) ? 64 : 48;
 			dsc_codec.mux_word_size = muxWordSize;
+			RANGE_CHECK("mux_word_size", dsc_codec.mux_word_size, 8, MAX_MUX_WORD_SIZE);
 		}
 		bufsize = dsc_codec.chunk_size * sliceh;   // Total number of bytes to generate
 		slices_per_line = (dsc_codec.pic_width + dsc_codec.slice_width - 1) / dsc_codec.slice_width;
-		buf = (unsigned char **)malloc(sizeof(unsigned char *) * slices_per_line);
-		for (i=0; i<slices_per_line; ++i)
-			buf[i] = (unsigned char *)malloc(bufsize);
 
-		op_dsc = (pic_t *)pcreate(FRAME, dsc_codec.convert_rgb ? RGB : YUV_HD, YUV_444, dsc_codec.pic_width, dsc_codec.pic_height);
+		op_dsc = pcreate16(FRAME, dsc_codec.convert_rgb ? RGB : YUV_HD, YUV_444, dsc_codec.pic_width, dsc_codec.pic_height);
 		op_dsc->bits = bitsPerComponent;
 		op_dsc->alpha = 0;
-		if (dsc_codec.convert_rgb)
-		{
-			int tpidx;
 
-			temp_pic = (pic_t **)malloc(sizeof(pic_t*) * 2);
-			for (tpidx=0; tpidx<2; ++tpidx)
+		// Every slice gets its own bitstream buffer so that slices can be coded in any order
+		numslices = slices_per_line * ((dsc_codec.pic_height+sliceh-1)/sliceh);
+		if ((numslices > buf_slices) || (bufsize > buf_size) || (sliceh > buf_rows))
+		{
+			free_slice_buffers(buf, chunk_sizes, buf_slices);
+			buf_slices = MAX(numslices, buf_slices);
+			buf_size = MAX(bufsize, buf_size);
+			buf_rows = MAX(sliceh, buf_rows);
+			buf = (unsigned char **)malloc(sizeof(unsigned char *) * buf_slices);
+			chunk_sizes = (int **)malloc(sizeof(int *) * buf_slices);
+			for (i=0; i<buf_slices; ++i)
 			{
-				// Space for converting to YCoCg
-				temp_pic[tpidx] = (pic_t *)pcreate(FRAME, YUV_HD, YUV_444, dsc_codec.pic_width, dsc_codec.pic_height);
-				temp_pic[tpidx]->bits = bitsPerComponent;
-				temp_pic[tpidx]->alpha = 0;	
+				buf[i] = (unsigned char *)malloc(buf_size);
+				chunk_sizes[i] = (int *)malloc(sizeof(int) * buf_rows);
 			}
 		}
-
-		slicecount = 0;
-		chunk_sizes = (int **)malloc(sizeof(int *) * slices_per_line);
-		for(i=0; i<slices_per_line; ++i)
-			chunk_sizes[i] = (int *)malloc(sizeof(int *) * sliceh);
-		for (ys = 0; ys < dsc_codec.pic_height; ys+=sliceh)
+		for (i=0; i<numslices; ++i)
+			memset(buf[i], 0, bufsize);
+		if(function == 2)
+			for (i=0; i<numslices; i+=slices_per_line)
+				read_dsc_data(&buf[i], dsc_codec.chunk_size, bits_fp, dsc_codec.vbr_enable, slices_per_line, dsc_codec.slice_height);
+
+		// Set up the codec context of each worker; they are only reset when the configuration changes
+		if (dsc_ctx == NULL)
 		{
-			if(function == 2)
-				read_dsc_data(buf, dsc_codec.chunk_size, bits_fp, dsc_codec.vbr_enable, slices_per_line, dsc_codec.slice_height);
-			for (xs = 0; xs < slices_per_line; xs++)
-			{
-				unsigned char *buf2;
-
-				buf2 = buf[xs];
-				numslices = ((dsc_codec.pic_width+slicew-1)/slicew) * ((dsc_codec.pic_height+sliceh-1)/sliceh);
-				printf("Processing slice %d / %d\r", ++slicecount, numslices);
-				fflush(stdout);  // For Bob.
-				if(function != 2)
-					memset(buf2, 0, bufsize);
-				dsc_codec.xstart = xs * slicew;
-				dsc_codec.ystart = ys;
-
-				// Encoder
-				if ((function==0) || (function==1))
-					DSC_Encode(&dsc_codec, ip, op_dsc, buf2, temp_pic, chunk_sizes[xs]);
-
-				// Decoder
-				if ((function==0) || (function == 2))
-					DSC_Decode(&dsc_codec, op_dsc, buf2, temp_pic); 
-			}
-			if(function == 1)
-				write_dsc_data(buf, dsc_codec.chunk_size, bits_fp, dsc_codec.vbr_enable, slices_per_line, dsc_codec.slice_height, chunk_sizes);
+			num_ctx = MAX(numThreads, 1);   // Any worker may pick up any slice
+			dsc_ctx = (dsc_context_t **)malloc(sizeof(dsc_context_t *) * num_ctx);
+			for (i=0; i<num_ctx; ++i)
+				if ((err = dsc_create(&dsc_codec, &dsc_ctx[i])) != DSC_OK)
+				{
+					fprintf(stderr, "ERROR: Failed to set up codec: %s\n", dsc_error_string(err));
+					exit(1);
+				}
 		}
-		printf("\n");
-		for(i=0; i<slices_per_line; ++i)
-			free(buf[i]);
-		free(buf);
-
-		if (temp_pic)
+		else if (memcmp(&ctx_cfg, &dsc_codec, sizeof(dsc_cfg_t)))
 		{
-			pdestroy(temp_pic[0]);
-			pdestroy(temp_pic[1]);
-			free(temp_pic);
+			for (i=0; i<num_ctx; ++i)
+				if ((err = dsc_reset(dsc_ctx[i], &dsc_codec)) != DSC_OK)
+				{
+					fprintf(stderr, "ERROR: Failed to set up codec: %s\n", dsc_error_string(err));
+					exit(1);
+				}
 		}
+		ctx_cfg = dsc_codec;
+
+		slice_jobs.dsc_cfg = &dsc_codec;
+		slice_jobs.dsc_ctx = dsc_ctx;
+		slice_jobs.ip = ip;
+		slice_jobs.op = op_dsc;
+		slice_jobs.buf = buf;
+		slice_jobs.chunk_sizes = chunk_sizes;
+		slice_jobs.slices_per_line = slices_per_line;
+		slice_jobs.numslices = numslices;
+		pool_run(workers, numslices, code_slice, &slice_jobs);
+		if (numThreads > 1)
+			printf("Processing slice %d / %d\r", numslices, numslices);
+
+		if(function == 1)
+			for (i=0; i<numslices; i+=slices_per_line)
+				write_dsc_data(&buf[i], dsc_codec.chunk_size, bits_fp, dsc_codec.vbr_enable, slices_per_line, dsc_codec.slice_height, &chunk_sizes[i]);
+		printf("\n");
 
 		// Convert 444 to 422 if coded as 422
 		if (dsc_codec.enable_422)
 		{
-			ip2 = pcreate(FRAME, op_dsc->color, YUV_422, op_dsc->w, op_dsc->h);
+			ip2 = pcreate16(FRAME, op_dsc->color, YUV_422, op_dsc->w, op_dsc->h);
 			ip2->bits = op_dsc->bits;
 			ip2->alpha = 0;
 			simple444to422(op_dsc, ip2);
@@ -1048,16 +1136,7 @@ int main(int argc, char *argv[])
 		{
 			// R/B swap
 			if (rbSwapOut)
-			{
-				for (i=0; i<op_dsc->h; ++i)
-					for (j=0; j<op_dsc->w; ++j)
-					{
-						int tmp;
-						tmp = op_dsc->data.rgb.r[i][j];
-						op_dsc->data.rgb.r[i][j] = op_dsc->data.rgb.b[i][j];
-						op_dsc->data.rgb.b[i][j] = tmp;
-					}
-			}
+				pswap_planes(op_dsc, 0, 2);
 			strcpy(f, fn_o);
 #ifdef WIN32
 			strcat(f, "\\");
@@ -1126,6 +1205,12 @@ int main(int argc, char *argv[])
 		fgets(infname, 512, list_fp);
 	}
 
+	pool_destroy(workers);
+	for (i=0; i<num_ctx; ++i)
+		dsc_destroy(dsc_ctx[i]);
+	free(dsc_ctx);
+	free_slice_buffers(buf, chunk_sizes, buf_slices);
+	ppool_free();
 	fclose(list_fp);
 	fclose(logfp);
 	free(rcOffset);
@@ -43,10 +43,25 @@
 *  NOTWITHSTANDING ANY FAILURE OF ESSENTIAL PURPOSE OF ANY LIMITED REMEDY.
 ***************************************************************************/
 
+#if (defined(__linux__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L   // fileno(), mmap()
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stddef.h>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#if (defined(__linux__) || defined(__APPLE__))
+#define DPX_USE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define DPX_USE_MMAP 0
+#endif
 #include "vdo.h"
 #include "utl.h"
 #include "dpx.h"
@@ -54,6 +69,8 @@
 
 #define BCMDPX_VERSION   "1.00"
 #define BCMDPX_420CODE   104
+#define DPX_WRITE_CHUNK  65536   // Words of image data buffered between writes
+#define DPX_SAMPLES_PER_WORD(bpp)  ((bpp) == 8 ? 4 : (bpp) == 10 ? 3 : 2)   // Samples packed in each 32-bit word
 #define READ_DPX_32(x)   (bswap ? (((((x) & 0xff) << 24) | (((x) & 0xff00) << 8) | (((x) & 0xff0000) >> 8) | ((x) >> 24))) : (x))
 #define READ_DPX_16(x)   (bswap ? ((((x) & 0xff) << 8) | (((x) & 0xff00) >> 8)) : (x))
 //#define SINGLE_BS(x)   data32b = *((DWORD *)(&(x)));  *((DWORD *)(&(x))) = READ_DPX_32(data32b);
@@ -236,10 +253,17 @@ typedef struct _DpxFileFormat
 
 static DWORD generate_timecode(int frameno, float framerate);
 static int create_dpx_pic(pic_t **p, chroma_t chroma, color_t color, int w, int h, int bits);
-static int read_dpx_image_data(FILE *fp, pic_t **p, int orientation, int sign, int bpp, int descriptor, int rle, int bugs, int w, int h, int bswap);
+static int read_dpx_image_data(FILE *fp, const BYTE *data, size_t size, pic_t **p, int orientation, int sign, int bpp, int descriptor, int rle, int bugs, int w, int h, int bswap);
+static const BYTE *dpx_map_file(FILE *fp, size_t *size);
+static void dpx_unmap_file(const BYTE *data, size_t size);
+static int write_dpx_image_data(char *fname, DPXFILEFORMAT *f, pic_t *p, int datum[4][6], int nbuffer, const int *ndatum, const int *subsampled, const int *wbuff, const int *hbuff, int bpp, int pad_line_ends, int bswap);
+
+// Plane indices of pic_t components for prow_get()
+enum { PLANE_Y = 0, PLANE_U = 1, PLANE_V = 2, PLANE_R = 0, PLANE_G = 1, PLANE_B = 2, PLANE_A = 3 };
 
 
 static color_t dpxcolor = 0;  /* implied init to 0 because global */
+static int dpxmmapout = 0;    /* write DPX files through mmap() */
 
 /* write_dpx() :
 Currently supports bpp=8, 10, 12 and 16 (in 2.0/Brdm mode) */
@@ -255,25 +279,23 @@ int write_dpx(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seqlen,
 
 int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seqlen, float framerate, int interlaced, int bpp, int ver, int pad_line_ends, int bswap)
 {
-	FILE *fp;
-	int i, j, k, xindex, b;
+	int i;
 	DPXFILEFORMAT f;
-
-	int element;
 	color_t c;
-	int **datum[4][6];
+	int datum[4][6];   // Plane of each component of each buffer
 	int nbuffer = 1;// Min = 1, Max = 0;
 	int ndatum[4];
 	int subsampled[4];
 	int wbuff[4];
 	int hbuff[4];
-	DWORD data32b = 0;
 	char *f_ptr;
 
 	memset(&f, 0, sizeof(DPXFILEFORMAT));
 	f_ptr = (char *)(&f);
 	ndatum[0] = 0; ndatum[1] = 0; ndatum[2] = 0; ndatum[3] = 0;
 	subsampled[0] = 0; subsampled[1] = 0; subsampled[2] = 0; subsampled[3] = 0;
+	wbuff[0] = 0; wbuff[1] = 0; wbuff[2] = 0; wbuff[3] = 0;
+	hbuff[0] = 0; hbuff[1] = 0; hbuff[2] = 0; hbuff[3] = 0;
 
 	// Color fix: Jan 2, 2007
 	//
@@ -506,16 +528,6 @@ int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seql
 	f.TvHeader.IntegrationTimes = 0;
 	SINGLE_BS(TvHeader.IntegrationTimes);
 
-	if ((fp = fopen(fname, "wb")) == NULL)
-	{
-		fprintf(stderr, "Cannot open %s for output\n", fname);
-		exit(1);
-	}
-
-	fwrite(&f, sizeof(DPXFILEFORMAT), 1, fp);
-
-	fseek(fp, 8192, SEEK_SET);
-
 #define BYTE_SWAP(x)  x = (((x & 0xff) << 24) | ((x & 0xff00) << 8) | ((x & 0xff0000) >> 8) | (x >> 24))
 
 	if (ver == STD_DPX_VER) // DPX standard 2.0
@@ -523,9 +535,9 @@ int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seql
 		if (p->color == RGB)
 		{
 			nbuffer = 1;
-			datum[0][0] = p->data.rgb.b;
-			datum[0][1] = p->data.rgb.g;
-			datum[0][2] = p->data.rgb.r;
+			datum[0][0] = PLANE_B;
+			datum[0][1] = PLANE_G;
+			datum[0][2] = PLANE_R;
 			if (p->alpha == 0)
 			{
 				ndatum[0] = 3;
@@ -533,7 +545,7 @@ int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seql
 			else
 			{
 				ndatum[0] = 4;
-				datum[0][3] = p->data.rgb.a;
+				datum[0][3] = PLANE_A;
 			}
 
 			subsampled[0] = 0;
@@ -544,20 +556,20 @@ int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seql
 			nbuffer = 1;
 			if (p->alpha == 0)
 			{
-				datum[0][0] = p->data.yuv.u;
-				datum[0][1] = p->data.yuv.y;
-				datum[0][2] = p->data.yuv.v;
-				datum[0][3] = p->data.yuv.y;
+				datum[0][0] = PLANE_U;
+				datum[0][1] = PLANE_Y;
+				datum[0][2] = PLANE_V;
+				datum[0][3] = PLANE_Y;
 				ndatum[0] = 4;
 			}
 			else
 			{
-				datum[0][0] = p->data.yuv.u;
-				datum[0][1] = p->data.yuv.y;
-				datum[0][2] = p->data.yuv.a;
-				datum[0][3] = p->data.yuv.v;
-				datum[0][4] = p->data.yuv.y;
-				datum[0][5] = p->data.yuv.a;
+				datum[0][0] = PLANE_U;
+				datum[0][1] = PLANE_Y;
+				datum[0][2] = PLANE_A;
+				datum[0][3] = PLANE_V;
+				datum[0][4] = PLANE_Y;
+				datum[0][5] = PLANE_A;
 				ndatum[0] = 6;
 			}
 			subsampled[0] = 1;
@@ -566,16 +578,16 @@ int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seql
 		} else if (p->chroma == YUV_444)
 		{
 			nbuffer = 1;
-			datum[0][0] = p->data.yuv.u;
-			datum[0][1] = p->data.yuv.y;
-			datum[0][2] = p->data.yuv.v;
+			datum[0][0] = PLANE_U;
+			datum[0][1] = PLANE_Y;
+			datum[0][2] = PLANE_V;
 			if (p->alpha == 0)
 			{
 				ndatum[0] = 3;
 			}
 			else
 			{
-				datum[0][3] = p->data.yuv.a;
+				datum[0][3] = PLANE_A;
 				ndatum[0] = 4;
 			}	      
 			subsampled[0] = 0;
@@ -586,9 +598,9 @@ int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seql
 			nbuffer = 2;
 			ndatum[0] = 1;
 			ndatum[1] = 2;
-			datum[0][0] = p->data.yuv.y;
-			datum[1][0] = p->data.yuv.u;
-			datum[1][1] = p->data.yuv.v;
+			datum[0][0] = PLANE_Y;
+			datum[1][0] = PLANE_U;
+			datum[1][1] = PLANE_V;
 			subsampled[0] = 0;
 			subsampled[1] = 0;
 			wbuff[0] = p->w;
@@ -596,66 +608,273 @@ int write_dpx_ver(char *fname, pic_t *p, int ar1, int ar2, int frameno, int seql
 			wbuff[1] = p->w / 2;
 			hbuff[1] = p->h / 2;
 		}
-		element = 0;
-		for (b = 0; b < nbuffer; b++) // Loop over buffers
+	} else
+	{
+		nbuffer = 0;   // Only the header is written
+	}
+
+	return(write_dpx_image_data(fname, &f, p, datum, nbuffer, ndatum, subsampled, wbuff, hbuff, bpp, pad_line_ends, bswap));
+}
+
+//! Add one sample to the DPX word being filled, and store the word once it is full
+/*! \param sample  Sample
+	\param bpp     Bits per sample (8, 10, 12 or 16)
+	\param bswap   Store words in the opposite byte order
+	\param data32b Word being filled (modified)
+	\param element Samples already in the word being filled (modified)
+	\param out     Where the word is stored when it is completed
+	\return        Number of words completed (0 or 1) */
+static inline int dpx_pack_sample(int sample, int bpp, int bswap, DWORD *data32b, int *element, DWORD *out)
+{
+	*data32b |= (DWORD)sample << ((bpp == 10) ? (*element)*10+2 : (*element)*((bpp == 8) ? 8 : 16));
+	*element = (*element + 1) % DPX_SAMPLES_PER_WORD(bpp);
+	if (*element != 0)
+		return (0);
+	*out = READ_DPX_32(*data32b);
+	*data32b = 0;
+	return (1);
+}
+
+
+//! Pack consecutive samples into a standard (DPX 2.0) word stream
+/*! \param in      Samples
+	\param n       Number of samples
+	\param bpp     Bits per sample (8, 10, 12 or 16)
+	\param bswap   Store words in the opposite byte order
+	\param partial Word being filled, carried between calls
+	\param element Samples already in the word being filled, carried between calls
+	\param out     Completed words
+	\return        Number of words completed */
+static int dpx_pack(const int *in, int n, int bpp, int bswap, DWORD *partial, int *element, DWORD *out)
+{
+	int   nw = 0;
+	DWORD data32b = *partial;
+
+	// Finish the partial word
+	for (; (n > 0) && *element; n--)
+		nw += dpx_pack_sample(*in++, bpp, bswap, &data32b, element, out + nw);
+
+#if defined(__SSE4_1__)
+	{
+		__m128i bs = _mm_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+		__m128i a, b, c, d, v;
+
+		if (bpp == 10)
 		{
-			for (i = 0; i < hbuff[b]; ++i) // every row
+			// Gather fields 0, 1 and 2 of four words from samples 0-3, 4-7 and 8-11
+			for (; n >= 12; n -= 12, in += 12, nw += 4)
 			{
-				for (j = 0; j<(subsampled[b] ? wbuff[b]/2 : wbuff[b]); ++j) // every pixel
-				{
-					for (k=0; k<ndatum[b]; ++k)
-					{
-						xindex = (ndatum[b] == 6) ? ((k%3 == 0) ? j : j*2 + (k/3)) : // "Hack" for UYAVYA (422 with alpha), only know mode to have ndatum == 6
-							(subsampled[b] && (k & 0x1)) ? j*2 + (k>>1) : j;
-						if (element == 0) data32b = 0;
-						switch (bpp)
-						{
-						case 12:
-						case 16:
-							data32b |= (datum[b][k][i][xindex] << (element<<4)); // Offset by 16 bits
-							element = (element+1) % 2; // 2 datums = 2*16 = 32bits per D-word
-							break;
-						case 10:
-							data32b |= (datum[b][k][i][xindex] << (element*10+2));
-							element = (element+1) % 3;
-							break;
-						case 8:
-							data32b |= (datum[b][k][i][xindex] << (element<<3));
-							element = (element+1) % 4;
-							break;
-						default:
-							return(DPX_ERROR_UNSUPPORTED_BPP);
-						}
-						if (element == 0)
-						{
-							data32b = READ_DPX_32(data32b);
-							fwrite(&data32b, 4, 1, fp);
-						}
-					}
-				} // end of a row
-				// fill in and start new from a new line.  -- this is to match XnView 1.93.
-				// Not sure this is standard compliant. Q.
-				if (pad_line_ends && (element != 0))
-				{
-					data32b = READ_DPX_32(data32b);
-					fwrite(&data32b, 4, 1, fp);
-					element = 0;
-				}
+				a = _mm_loadu_si128((const __m128i *)in);
+				b = _mm_loadu_si128((const __m128i *)(in + 4));
+				c = _mm_loadu_si128((const __m128i *)(in + 8));
+				d = _mm_shuffle_epi32(_mm_blend_epi16(_mm_blend_epi16(a, b, 0x30), c, 0x0c), _MM_SHUFFLE(1,2,3,0));
+				v = _mm_slli_epi32(d, 2);
+				d = _mm_shuffle_epi32(_mm_blend_epi16(_mm_blend_epi16(b, a, 0x0c), c, 0x30), _MM_SHUFFLE(2,3,0,1));
+				v = _mm_or_si128(v, _mm_slli_epi32(d, 12));
+				d = _mm_shuffle_epi32(_mm_blend_epi16(_mm_blend_epi16(c, b, 0x0c), a, 0x30), _MM_SHUFFLE(3,0,1,2));
+				v = _mm_or_si128(v, _mm_slli_epi32(d, 22));
+				if (bswap)
+					v = _mm_shuffle_epi8(v, bs);
+				_mm_storeu_si128((__m128i *)(out + nw), v);
+			}
+		}
+		else if (bpp == 8)
+		{
+			__m128i m = _mm_setr_epi32(1, 1<<8, 1<<16, 1<<24);
+
+			// Shift each sample into place, then OR the four lanes of each word together
+			for (; n >= 16; n -= 16, in += 16, nw += 4)
+			{
+				a = _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)in), m);
+				b = _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(in + 4)), m);
+				c = _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(in + 8)), m);
+				d = _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(in + 12)), m);
+				a = _mm_or_si128(_mm_unpacklo_epi32(a, b), _mm_unpackhi_epi32(a, b));
+				c = _mm_or_si128(_mm_unpacklo_epi32(c, d), _mm_unpackhi_epi32(c, d));
+				v = _mm_or_si128(_mm_unpacklo_epi64(a, c), _mm_unpackhi_epi64(a, c));
+				if (bswap)
+					v = _mm_shuffle_epi8(v, bs);
+				_mm_storeu_si128((__m128i *)(out + nw), v);
 			}
 		}
-		if(element != 0)
+		else
 		{
-			data32b = READ_DPX_32(data32b);
-			fwrite(&data32b, 4, 1, fp);
+			// Even lanes take the odd sample shifted up, then the even lanes are compacted
+			for (; n >= 8; n -= 8, in += 8, nw += 4)
+			{
+				a = _mm_loadu_si128((const __m128i *)in);
+				b = _mm_loadu_si128((const __m128i *)(in + 4));
+				a = _mm_or_si128(a, _mm_srli_epi64(_mm_slli_epi32(a, 16), 32));
+				b = _mm_or_si128(b, _mm_srli_epi64(_mm_slli_epi32(b, 16), 32));
+				v = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3,1,2,0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3,1,2,0)));
+				if (bswap)
+					v = _mm_shuffle_epi8(v, bs);
+				_mm_storeu_si128((__m128i *)(out + nw), v);
+			}
 		}
+	}
+#endif
 
-		fclose(fp);
-		return(0);
-	} // end of writting DPX standard 2.0
+	for (; n > 0; n--)
+		nw += dpx_pack_sample(*in++, bpp, bswap, &data32b, element, out + nw);
+	*partial = data32b;
+	return(nw);
+}
 
+
+//! Write the header and image elements of a standard (DPX 2.0) file
+/*! Each row is gathered and packed into a word buffer that is written with large sequential
+    writes, or packed straight into the mapped file when mmap output is enabled.
+	\param fname    File name
+	\param f        Header
+	\param p        Picture
+	\param datum    Plane of each component of each buffer
+	\param nbuffer  Number of image element buffers (0 writes the header only)
+	\param ndatum   Components per pixel (or pixel pair for 4:2:2) in each buffer
+	\param subsampled Components are stored for pixel pairs
+	\param wbuff    Width of each buffer
+	\param hbuff    Height of each buffer
+	\param bpp      Bits per sample
+	\param pad_line_ends Start every row on a word boundary
+	\param bswap    Store words in the opposite byte order
+	\return         0 on success */
+static int write_dpx_image_data(char *fname, DPXFILEFORMAT *f, pic_t *p, int datum[4][6], int nbuffer, const int *ndatum, const int *subsampled, const int *wbuff, const int *hbuff, int bpp, int pad_line_ends, int bswap)
+{
+	FILE  *fp;
+	int    spw = DPX_SAMPLES_PER_WORD(bpp);
+	size_t nwords = 0, nsamp_total = 0, pos = 0, cap;
+	DWORD *out = NULL, *buf = NULL;
+	BYTE  *map = NULL;
+	DWORD  data32b = 0;
+	int    element = 0;
+	int    xm[6], xa[6];
+	int    npix, nsamp, max_nsamp = 0;
+	int   *line, *s, *rows, *src;
+	int    b, i, j, k;
+
+	if ((bpp != 8) && (bpp != 10) && (bpp != 12) && (bpp != 16))
+		return(DPX_ERROR_UNSUPPORTED_BPP);
+
+	// Words in the image data
+	for (b = 0; b < nbuffer; b++)
+	{
+		nsamp = (subsampled[b] ? wbuff[b]/2 : wbuff[b]) * ndatum[b];
+		max_nsamp = MAX(max_nsamp, nsamp);
+		if (pad_line_ends)
+			nwords += (size_t)hbuff[b] * ((nsamp + spw - 1) / spw);
+		else
+			nsamp_total += (size_t)hbuff[b] * nsamp;
+	}
+	nwords += (nsamp_total + spw - 1) / spw;
+
+	if ((fp = fopen(fname, dpxmmapout ? "w+b" : "wb")) == NULL)
+	{
+		fprintf(stderr, "Cannot open %s for output\n", fname);
+		exit(1);
+	}
+
+#if DPX_USE_MMAP
+	if (dpxmmapout && nwords && !ftruncate(fileno(fp), (off_t)(8192 + nwords * 4)))
+	{
+		map = (BYTE *)mmap(NULL, 8192 + nwords * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(fp), 0);
+		if (map == (BYTE *)MAP_FAILED)
+			map = NULL;
+	}
+#endif
+	if (map)
+	{
+		memcpy(map, f, sizeof(DPXFILEFORMAT));
+		out = (DWORD *)(map + 8192);
+		cap = nwords;
+	}
+	else
+	{
+		fwrite(f, sizeof(DPXFILEFORMAT), 1, fp);
+		fseek(fp, 8192, SEEK_SET);
+		cap = MAX(DPX_WRITE_CHUNK, (size_t)max_nsamp + 1);
+		buf = out = (DWORD *)malloc(cap * sizeof(DWORD));
+	}
+	line = (int *)malloc((max_nsamp + 1) * sizeof(int));
+	rows = (int *)malloc((size_t)p->w * sizeof(int));   // Widened row of a plane with 16-bit samples
+	if ((out == NULL) || (line == NULL) || (rows == NULL))
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
+
+	for (b = 0; b < nbuffer; b++) // Loop over buffers
+	{
+		npix = subsampled[b] ? wbuff[b]/2 : wbuff[b];
+		nsamp = npix * ndatum[b];
+		for (k = 0; k < ndatum[b]; k++)
+		{
+			if (ndatum[b] == 6)        // "Hack" for UYAVYA (422 with alpha), only know mode to have ndatum == 6
+			{
+				xm[k] = (k%3 == 0) ? 1 : 2;
+				xa[k] = (k%3 == 0) ? 0 : k/3;
+			}
+			else
+			{
+				xm[k] = (subsampled[b] && (k & 0x1)) ? 2 : 1;
+				xa[k] = (subsampled[b] && (k & 0x1)) ? k>>1 : 0;
+			}
+		}
+
+		for (i = 0; i < hbuff[b]; ++i) // every row
+		{
+			for (k = 0; k < ndatum[b]; k++)
+			{
+				src = prow_get(p, datum[b][k], i, rows);
+				s = line + k;
+				for (j = 0; j < npix; j++, s += ndatum[b])
+					*s = src[j*xm[k] + xa[k]];
+			}
+
+			if (!map && (pos + nsamp + 1 > cap))
+			{
+				fwrite(buf, sizeof(DWORD), pos, fp);
+				pos = 0;
+			}
+			pos += dpx_pack(line, nsamp, bpp, bswap, &data32b, &element, out + pos);
+
+			// fill in and start new from a new line.  -- this is to match XnView 1.93.
+			// Not sure this is standard compliant. Q.
+			if (pad_line_ends && (element != 0))
+			{
+				out[pos++] = READ_DPX_32(data32b);
+				data32b = 0;
+				element = 0;
+			}
+		}
+	}
+	if (element != 0)
+		out[pos++] = READ_DPX_32(data32b);
+
+	if (map)
+	{
+#if DPX_USE_MMAP
+		munmap(map, 8192 + nwords * 4);
+#endif
+	}
+	else
+	{
+		fwrite(buf, sizeof(DWORD), pos, fp);
+		free(buf);
+	}
+	free(line);
+	free(rows);
+	fclose(fp);
 	return(0);
 }
 
+
+/* Write DPX files by mapping them into memory (0 disables) */
+void set_dpx_mmap_output(int enable)
+{
+	dpxmmapout = enable;
+}
+
+
 #define DEC2HEX(a) ( (((a)/10) << 4) | ((a) % 10) )
 static DWORD generate_timecode(int frameno, float framerate)
 {
@@ -712,6 +931,9 @@ int dpx_read_hl(char *fname, pic_t **p, int* highdata, int*lowdata, int dpx_bugs
 	int bugs = 0;
 	static int show_range_warn = 1; // Allow range warning for only the first file.
 	int bpp;
+	const BYTE *map;
+	size_t map_size = 0;
+	DWORD offset;
 
 	if ((fp = fopen(fname, "rb")) == NULL)
 	{
@@ -751,20 +973,28 @@ int dpx_read_hl(char *fname, pic_t **p, int* highdata, int*lowdata, int dpx_bugs
 	if(dpx_bugs>=0)		// Bugs override
 		bugs = dpx_bugs;  
 
+	map = dpx_map_file(fp, &map_size);
 	for (i=0; i<READ_DPX_16(f.ImageHeader.NumberElements); ++i)
 	{
-		fseek(fp, READ_DPX_32(f.ImageHeader.ImageElement[i].DataOffset), SEEK_SET);
+		offset = READ_DPX_32(f.ImageHeader.ImageElement[i].DataOffset);
+		fseek(fp, offset, SEEK_SET);
 
-		ecode = read_dpx_image_data(fp, p, READ_DPX_16(f.ImageHeader.Orientation), READ_DPX_32(f.ImageHeader.ImageElement[i].DataSign),
+		ecode = read_dpx_image_data(fp, (map && (offset < map_size)) ? map + offset : NULL, map_size - offset,
+			p, READ_DPX_16(f.ImageHeader.Orientation), READ_DPX_32(f.ImageHeader.ImageElement[i].DataSign),
 			f.ImageHeader.ImageElement[i].BitSize, f.ImageHeader.ImageElement[i].Descriptor,
 			READ_DPX_16(f.ImageHeader.ImageElement[i].Encoding), bugs, w, h, bswap);
 		if (ecode)
 		{
+			dpx_unmap_file(map, map_size);
 			return(ecode);
 		}
 		if((*p)==NULL)
+		{
+			dpx_unmap_file(map, map_size);
 			return(DPX_ERROR_MALLOC_FAIL);
+		}
 	}
+	dpx_unmap_file(map, map_size);
 	if ((f.ImageHeader.ImageElement[0].Transfer == 5) || (f.ImageHeader.ImageElement[0].Transfer == 6))
 	{
 		(*p)->color = YUV_HD;
@@ -845,13 +1075,267 @@ int dpx_read_hl(char *fname, pic_t **p, int* highdata, int*lowdata, int dpx_bugs
 }
 
 
+//! Map the whole of an open DPX file for reading
+/*! Uses mmap() where available, and otherwise reads the file with a single block read.
+    \param fp      Open file
+	\param size    Returns the file size in bytes
+	\return        Pointer to the file contents, or NULL if they could not be mapped */
+static const BYTE *dpx_map_file(FILE *fp, size_t *size)
+{
+#if DPX_USE_MMAP
+	struct stat st;
+	void *m;
+
+	if (fstat(fileno(fp), &st) || (st.st_size <= 0))
+		return(NULL);
+	m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	if (m == MAP_FAILED)
+		return(NULL);
+	*size = (size_t)st.st_size;
+	return((const BYTE *)m);
+#else
+	BYTE *m;
+	long len;
+
+	if (fseek(fp, 0, SEEK_END) || ((len = ftell(fp)) <= 0) || fseek(fp, 0, SEEK_SET))
+		return(NULL);
+	if ((m = (BYTE *)malloc(len)) == NULL)
+		return(NULL);
+	if (fread(m, 1, len, fp) != (size_t)len)
+	{
+		free(m);
+		return(NULL);
+	}
+	*size = (size_t)len;
+	return(m);
+#endif
+}
+
+
+//! Release a file mapped with dpx_map_file()
+/*! \param data    Pointer returned by dpx_map_file() (may be NULL)
+	\param size    File size in bytes */
+static void dpx_unmap_file(const BYTE *data, size_t size)
+{
+	if (data == NULL)
+		return;
+#if DPX_USE_MMAP
+	munmap((void *)data, size);
+#else
+	free((void *)data);
+#endif
+}
+
+
+//! Extract one sample from a standard (DPX 2.0) packed stream
+/*! \param data    Start of the packed words
+	\param bpp     Bits per sample (8, 10, 12 or 16)
+	\param bswap   Words are stored in the opposite byte order
+	\param s       Sample index from data
+	\return        Sample value */
+static int dpx_sample(const BYTE *data, int bpp, int bswap, size_t s)
+{
+	int   spw = DPX_SAMPLES_PER_WORD(bpp);
+	int   n = (int)(s % spw);
+	DWORD data32b;
+
+	memcpy(&data32b, data + (s / spw) * 4, 4);
+	if (bswap)
+	{
+		BYTE_SWAP(data32b);
+	}
+	if (bpp == 8)
+		return((data32b >> (n*8)) & 0xff);
+	if (bpp == 10)
+		return((data32b >> (2+10*n)) & 0x3ff);
+	return((data32b >> (n*16)) & 0xffff);   // 12 bits are stored in 16-bit containers
+}
+
+
+//! Unpack consecutive samples from a standard (DPX 2.0) packed stream
+/*! \param data    Start of the packed words
+	\param bpp     Bits per sample (8, 10, 12 or 16)
+	\param bswap   Words are stored in the opposite byte order
+	\param s       Index of the first sample from data
+	\param n       Number of samples
+	\param out     Unpacked samples */
+static void dpx_unpack(const BYTE *data, int bpp, int bswap, size_t s, int n, int *out)
+{
+	int spw = DPX_SAMPLES_PER_WORD(bpp);
+	const BYTE *src;
+
+	// Samples before the first word boundary
+	for (; (n > 0) && (s % spw); n--)
+		*out++ = dpx_sample(data, bpp, bswap, s++);
+	src = data + (s / spw) * 4;
+
+#if defined(__AVX2__)
+	{
+		__m256i bs = _mm256_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12, 3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+		__m256i v;
+
+		if (bpp == 10)
+		{
+			// Lane l of output group g takes word (8g+l)/3, field (8g+l)%3 moved to the top bits by a variable shift
+			const __m256i idx[3] = { _mm256_setr_epi32(0,0,0,1,1,1,2,2), _mm256_setr_epi32(2,3,3,3,4,4,4,5), _mm256_setr_epi32(5,5,6,6,6,7,7,7) };
+			const __m256i sh[3]  = { _mm256_setr_epi32(20,10,0,20,10,0,20,10), _mm256_setr_epi32(0,20,10,0,20,10,0,20), _mm256_setr_epi32(10,0,20,10,0,20,10,0) };
+			int g;
+
+			for (; n >= 24; n -= 24, src += 32, out += 24)
+			{
+				v = _mm256_loadu_si256((const __m256i *)src);
+				if (bswap)
+					v = _mm256_shuffle_epi8(v, bs);
+				for (g = 0; g < 3; g++)
+					_mm256_storeu_si256((__m256i *)(out + 8*g), _mm256_srli_epi32(_mm256_sllv_epi32(_mm256_permutevar8x32_epi32(v, idx[g]), sh[g]), 22));
+			}
+		}
+		else if (bpp == 8)
+		{
+			__m128i b;
+
+			for (; n >= 16; n -= 16, src += 16, out += 16)
+			{
+				b = _mm_loadu_si128((const __m128i *)src);
+				if (bswap)
+					b = _mm_shuffle_epi8(b, _mm256_castsi256_si128(bs));
+				_mm256_storeu_si256((__m256i *)out, _mm256_cvtepu8_epi32(b));
+				_mm256_storeu_si256((__m256i *)(out + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(b, 8)));
+			}
+		}
+		else
+		{
+			__m128i b;
+
+			for (; n >= 8; n -= 8, src += 16, out += 8)
+			{
+				b = _mm_loadu_si128((const __m128i *)src);
+				if (bswap)
+					b = _mm_shuffle_epi8(b, _mm256_castsi256_si128(bs));
+				_mm256_storeu_si256((__m256i *)out, _mm256_cvtepu16_epi32(b));
+			}
+		}
+	}
+#elif defined(__SSE4_1__)
+	{
+		__m128i bs = _mm_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+		__m128i v;
+
+		if (bpp == 10)
+		{
+			// Move field n of each word to the top bits by multiplying by 2^(20-10n)
+			__m128i m0 = _mm_setr_epi32(1<<20, 1<<10, 1, 1<<20);
+			__m128i m1 = _mm_setr_epi32(1<<10, 1, 1<<20, 1<<10);
+			__m128i m2 = _mm_setr_epi32(1, 1<<20, 1<<10, 1);
+
+			for (; n >= 12; n -= 12, src += 16, out += 12)
+			{
+				v = _mm_loadu_si128((const __m128i *)src);
+				if (bswap)
+					v = _mm_shuffle_epi8(v, bs);
+				_mm_storeu_si128((__m128i *)out,       _mm_srli_epi32(_mm_mullo_epi32(_mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,0,0)), m0), 22));
+				_mm_storeu_si128((__m128i *)(out + 4), _mm_srli_epi32(_mm_mullo_epi32(_mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,1,1)), m1), 22));
+				_mm_storeu_si128((__m128i *)(out + 8), _mm_srli_epi32(_mm_mullo_epi32(_mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,2)), m2), 22));
+			}
+		}
+		else if (bpp == 8)
+		{
+			for (; n >= 16; n -= 16, src += 16, out += 16)
+			{
+				v = _mm_loadu_si128((const __m128i *)src);
+				if (bswap)
+					v = _mm_shuffle_epi8(v, bs);
+				_mm_storeu_si128((__m128i *)out,        _mm_cvtepu8_epi32(v));
+				_mm_storeu_si128((__m128i *)(out + 4),  _mm_cvtepu8_epi32(_mm_srli_si128(v, 4)));
+				_mm_storeu_si128((__m128i *)(out + 8),  _mm_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+				_mm_storeu_si128((__m128i *)(out + 12), _mm_cvtepu8_epi32(_mm_srli_si128(v, 12)));
+			}
+		}
+		else
+		{
+			for (; n >= 8; n -= 8, src += 16, out += 8)
+			{
+				v = _mm_loadu_si128((const __m128i *)src);
+				if (bswap)
+					v = _mm_shuffle_epi8(v, bs);
+				_mm_storeu_si128((__m128i *)out,       _mm_cvtepu16_epi32(v));
+				_mm_storeu_si128((__m128i *)(out + 4), _mm_cvtepu16_epi32(_mm_srli_si128(v, 8)));
+			}
+		}
+	}
+#endif
+	for (s = 0; n > 0; n--)
+		*out++ = dpx_sample(src, bpp, bswap, s++);
+}
+
+
+//! Read a single-buffer image element from memory
+/*! Handles unsigned 8, 10, 12 and 16-bit samples packed as in DPX 2.0 files, with the same
+    layout rules as the stream reader: 10-bit lines start on a word boundary, other depths
+	are packed continuously across lines.
+	\param data     Start of the image element
+	\param size     Bytes available from data
+	\param ptr      Destination rows of each component
+	\param ncomp    Number of components per pixel (or pixel pair for 4:2:2)
+	\param subs     Position of each component in a 4:2:2 pixel pair (0: shared, 1: first, 2: second)
+	\param subsampled Components are stored for pixel pairs
+	\param skip_read Components that are not stored in the picture
+	\param bpp      Bits per sample
+	\param w        Picture width
+	\param h        Picture height
+	\param bswap    Words are stored in the opposite byte order
+	\return         0 on success, nonzero if the element does not fit in size */
+static int read_dpx_image_mem(const BYTE *data, size_t size, int ***ptr, int ncomp, const int *subs, int subsampled, const int *skip_read, int bpp, int w, int h, int bswap)
+{
+	int    npix = subsampled ? w/2 : w;
+	int    nsamp = npix * ncomp;
+	int    spw = DPX_SAMPLES_PER_WORD(bpp);
+	size_t line_words = (nsamp + spw - 1) / spw;
+	int    xm[6], xa[6];
+	int   *line, *s;
+	int    i, j, k;
+
+	if (((bpp == 10) ? line_words * h * 4 : (((size_t)nsamp * h + spw - 1) / spw) * 4) > size)
+		return(1);
+	if ((line = (int *)malloc(MAX(nsamp, 1) * sizeof(int))) == NULL)
+		return(1);
+
+	for (k = 0; k < ncomp; k++)
+	{
+		xm[k] = (subsampled && subs[k]) ? 2 : 1;
+		xa[k] = (subsampled && (subs[k] == 2)) ? 1 : 0;
+	}
+
+	for (i = 0; i < h; i++)
+	{
+		if (bpp == 10)
+			dpx_unpack(data + line_words * i * 4, bpp, bswap, 0, nsamp, line);
+		else
+			dpx_unpack(data, bpp, bswap, (size_t)nsamp * i, nsamp, line);
+
+		for (k = 0; k < ncomp; k++)
+		{
+			if (skip_read[k])
+				continue;
+			s = line + k;
+			for (j = 0; j < npix; j++, s += ncomp)
+				ptr[k][i][j*xm[k] + xa[k]] = *s;
+		}
+	}
+	free(line);
+	return(0);
+}
+
+
 /**************************************************/
 /* bugs            Compatibility                  */
 /* 0               Standard                       */
 /* 1               XNView 1.82 (not supported)    */
 /* 2               DVS 2.1.2                      */
 /**************************************************/
-static int read_dpx_image_data(FILE *fp, pic_t **p, int orientation, int sign, int bpp, int descriptor, int rle, int bugs, int w, int h, int bswap)
+/* data/size give the image element in memory if the    */
+/* file could be mapped (see dpx_map_file()), else NULL */
+static int read_dpx_image_data(FILE *fp, const BYTE *data, size_t size, pic_t **p, int orientation, int sign, int bpp, int descriptor, int rle, int bugs, int w, int h, int bswap)
 {
 	int **ptr[4][6];
 	int nbuffer = 1; // min = 1, max = 4
@@ -1088,6 +1572,14 @@ static int read_dpx_image_data(FILE *fp, pic_t **p, int orientation, int sign, i
 	}
 
 	//fprintf(stderr, "descriptor=%d bugs=%d bswap=%d\n", descriptor, bugs, bswap);
+
+	// Unpack common unsigned packings straight from memory
+	if (data && !bugs && !sign && (nbuffer == 1) && ((bpp == 8) || (bpp == 10) || (bpp == 12) || (bpp == 16)))
+	{
+		if (!read_dpx_image_mem(data, size, ptr[0], ncomponents[0], subs[0], subsampled_x[0], skip_read, bpp, wbuff[0], hbuff[0], bswap))
+			return(0);
+	}
+
 	for (b = 0; b < nbuffer; b++)
 	{
 		for (i = 0; i < hbuff[b]; ++i)
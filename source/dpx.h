@@ -65,6 +65,7 @@ int      ends_in_percentd(char* str, int length);
 int      dpx_write(char *fname, pic_t *p, int pad_line_ends, int bswap);
 int      dpx_read(char *fname, pic_t **p, int dpx_bugs);
 void     set_dpx_colorspace(int color);
+void     set_dpx_mmap_output(int enable);
 
 int      dpx_read_hl(char *fname, pic_t **p, int *high, int *low, int dpx_bugs);
 
@@ -55,6 +55,9 @@
 #include <math.h>
 #include <memory.h>
 #include <assert.h>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
 #include "dsc_utils.h"
 #include "dsc_codec.h"
 #include "dsc_types.h"
@@ -65,6 +68,14 @@
 #define PRINT_DEBUG_RC    0
 #define PRINT_DEBUG_RECON 0
 
+#if defined(_MSC_VER)
+#define DSC_FORCEINLINE __forceinline
+#elif defined(__GNUC__)
+#define DSC_FORCEINLINE inline __attribute__((always_inline))
+#else
+#define DSC_FORCEINLINE inline
+#endif
+
 // Prototypes
 int MapQpToQlevel(dsc_state_t *dsc_state, int qp, int CType);
 int FindResidualSize(int eq);
@@ -162,87 +173,278 @@ int GetQpAdjPredSize(dsc_state_t *dsc_state, int cpnt)
 }
 
 
-//! Get the predicted sample value
-/*! \param prevLine  Array of samples from previous (reconstructed) line
-	\param currLine  Array of samples from current (reconstructed) line
-	\param hPos      Horizontal position within slice of sample to predict
-	\param predType  Prediction mode to use (PT_MAP or one of PT_BLOCK)
-	\param qLevel    Quantization level for current component
-	\param cpnt      Which component
-	\return          Predicted sample value */
-int SamplePredict(
-	dsc_state_t *dsc_state,
-	int* prevLine,          // reconstructed samples for previous line
-	int* currLine,          // reconstructed samples for current line
-	int hPos,               // horizontal position for sample to predict
-	PRED_TYPE predType,     // predictor to use
-	int qLevel,
-	int cpnt)
+//! Evaluate the prediction of a whole group
+/*! MAP and LEFT only depend on the line above, the pixel to the left of the group and the group's own quantized
+    residuals, so everything but the residual term is computed here for all pixels and components.
+	\param dsc_state DSC state structure
+	\param prevLine  Samples from previous (reconstructed) line for each component
+	\param currLine  Samples from current (reconstructed) line for each component
+	\param hPos      Horizontal position within slice of the first pixel of the group
+	\param predType  Prediction mode to use (PT_MAP, PT_LEFT or one of PT_BLOCK)
+	\param qlevel    Quantization level for each component
+	\param gp        Returned group prediction */
+static void GroupPredictSetup(dsc_state_t *dsc_state, int **prevLine, int **currLine, int hPos, PRED_TYPE predType, const int *qlevel, group_pred_t *gp)
 {
-	int a, b, c, d, e;
-	int filt_b, filt_c, filt_d, filt_e;
-	int blend_b, blend_c, blend_d, blend_e;
-	int p;
+	int idx = (hPos / 3) * 3 + PADDING_LEFT;
+	int k, cpnt;
 	int bp_offset;
-	int diff = 0;
-	int h_offset_array_idx;
-
-	h_offset_array_idx = (hPos / 3) * 3 + PADDING_LEFT; 
-
-	// organize samples into variable array defined in dsc spec
-	c = prevLine[h_offset_array_idx-1];
-	b = prevLine[h_offset_array_idx];
-	d = prevLine[h_offset_array_idx+1];
-	e = prevLine[h_offset_array_idx+2];
-	a = currLine[h_offset_array_idx-1];
-
-#define FILT3(a,b,c) (((a)+2*(b)+(c)+2)>>2)
-	filt_c = FILT3(prevLine[h_offset_array_idx-2], prevLine[h_offset_array_idx-1], prevLine[h_offset_array_idx]);
-	filt_b = FILT3(prevLine[h_offset_array_idx-1], prevLine[h_offset_array_idx], prevLine[h_offset_array_idx+1]);
-	filt_d = FILT3(prevLine[h_offset_array_idx], prevLine[h_offset_array_idx+1], prevLine[h_offset_array_idx+2]);
-	filt_e = FILT3(prevLine[h_offset_array_idx+1], prevLine[h_offset_array_idx+2], prevLine[h_offset_array_idx+3]);
 
+	gp->leftChain = 0;
 	switch (predType) {
 	case PT_MAP:	// MAP prediction
+	{
 		// *MODEL NOTE* MN_MMAP
-		diff = CLAMP(filt_c - c, -(QuantDivisor[qLevel]/2), QuantDivisor[qLevel]/2);
-		blend_c = c + diff;
-		diff = CLAMP(filt_b - b, -(QuantDivisor[qLevel]/2), QuantDivisor[qLevel]/2);
-		blend_b = b + diff;
-		diff = CLAMP(filt_d - d, -(QuantDivisor[qLevel]/2), QuantDivisor[qLevel]/2);
-		blend_d = d + diff;
-		diff = CLAMP(filt_e - e, -(QuantDivisor[qLevel]/2), QuantDivisor[qLevel]/2);
-		blend_e = e + diff;
-		
+#if defined(__SSE4_1__)
+		__m128i s[6], half, a, blend_b, blend_c, blend_d, blend_e, lo, hi;
+		int i;
+
+		// s[i] holds prevLine[idx-2+i] for all components; c, b, d, e are s[1..4]
+		for (i=0; i<6; ++i)
+			s[i] = _mm_setr_epi32(prevLine[0][idx-2+i], prevLine[1][idx-2+i], prevLine[2][idx-2+i], 0);
+		a = _mm_setr_epi32(currLine[0][idx-1], currLine[1][idx-1], currLine[2][idx-1], 0);
+		half = _mm_setr_epi32(QuantDivisor[qlevel[0]]/2, QuantDivisor[qlevel[1]]/2, QuantDivisor[qlevel[2]]/2, 0);
+
+		// blend = x + CLAMP(FILT3(left, x, right) - x, -half, half)
+#define BLEND_SSE(l, x, r) _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(l, _mm_slli_epi32(x, 1)), \
+			_mm_add_epi32(r, _mm_set1_epi32(2))), 2), _mm_sub_epi32(x, half)), _mm_add_epi32(x, half))
+		blend_c = BLEND_SSE(s[0], s[1], s[2]);
+		blend_b = BLEND_SSE(s[1], s[2], s[3]);
+		blend_d = BLEND_SSE(s[2], s[3], s[4]);
+		blend_e = BLEND_SSE(s[3], s[4], s[5]);
+#undef BLEND_SSE
 		// Pixel on line above off the raster to the left gets same value as pixel below (ie., midpoint)
 		if (hPos/SAMPLES_PER_UNIT == 0)
 			blend_c = a;
-		
-		if ((hPos % SAMPLES_PER_UNIT)==0)  // First pixel of group
-			p = CLAMP(a + blend_b - blend_c, MIN(a, blend_b), MAX(a, blend_b));
-		else if ((hPos % SAMPLES_PER_UNIT)==1)   // Second pixel of group
-			p = CLAMP(a + blend_d - blend_c + (dsc_state->quantizedResidual[cpnt][0] * QuantDivisor[qLevel]),
-				        MIN(MIN(a, blend_b), blend_d), MAX(MAX(a, blend_b), blend_d));
-		else    // Third pixel of group
-			p = CLAMP(a + blend_e - blend_c + (dsc_state->quantizedResidual[cpnt][0] + dsc_state->quantizedResidual[cpnt][1])*QuantDivisor[qLevel],
-						MIN(MIN(a,blend_b), MIN(blend_d, blend_e)), MAX(MAX(a,blend_b), MAX(blend_d, blend_e)));
+
+		lo = _mm_min_epi32(a, blend_b);
+		hi = _mm_max_epi32(a, blend_b);
+		_mm_storeu_si128((__m128i *)gp->base[0], _mm_sub_epi32(_mm_add_epi32(a, blend_b), blend_c));
+		_mm_storeu_si128((__m128i *)gp->lo[0], lo);
+		_mm_storeu_si128((__m128i *)gp->hi[0], hi);
+		lo = _mm_min_epi32(lo, blend_d);
+		hi = _mm_max_epi32(hi, blend_d);
+		_mm_storeu_si128((__m128i *)gp->base[1], _mm_sub_epi32(_mm_add_epi32(a, blend_d), blend_c));
+		_mm_storeu_si128((__m128i *)gp->lo[1], lo);
+		_mm_storeu_si128((__m128i *)gp->hi[1], hi);
+		lo = _mm_min_epi32(lo, blend_e);
+		hi = _mm_max_epi32(hi, blend_e);
+		_mm_storeu_si128((__m128i *)gp->base[2], _mm_sub_epi32(_mm_add_epi32(a, blend_e), blend_c));
+		_mm_storeu_si128((__m128i *)gp->lo[2], lo);
+		_mm_storeu_si128((__m128i *)gp->hi[2], hi);
+#else
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			int *prev = prevLine[cpnt];
+			int a, b, c, d, e;
+			int half = QuantDivisor[qlevel[cpnt]]/2;
+			int blend_b, blend_c, blend_d, blend_e;
+
+			// organize samples into variable array defined in dsc spec
+			c = prev[idx-1];
+			b = prev[idx];
+			d = prev[idx+1];
+			e = prev[idx+2];
+			a = currLine[cpnt][idx-1];
+
+#define FILT3(a,b,c) (((a)+2*(b)+(c)+2)>>2)
+			blend_c = c + CLAMP(FILT3(prev[idx-2], prev[idx-1], prev[idx]) - c, -half, half);
+			blend_b = b + CLAMP(FILT3(prev[idx-1], prev[idx], prev[idx+1]) - b, -half, half);
+			blend_d = d + CLAMP(FILT3(prev[idx], prev[idx+1], prev[idx+2]) - d, -half, half);
+			blend_e = e + CLAMP(FILT3(prev[idx+1], prev[idx+2], prev[idx+3]) - e, -half, half);
+#undef FILT3
+			// Pixel on line above off the raster to the left gets same value as pixel below (ie., midpoint)
+			if (hPos/SAMPLES_PER_UNIT == 0)
+				blend_c = a;
+
+			gp->base[0][cpnt] = a + blend_b - blend_c;
+			gp->lo[0][cpnt] = MIN(a, blend_b);
+			gp->hi[0][cpnt] = MAX(a, blend_b);
+			gp->base[1][cpnt] = a + blend_d - blend_c;
+			gp->lo[1][cpnt] = MIN(gp->lo[0][cpnt], blend_d);
+			gp->hi[1][cpnt] = MAX(gp->hi[0][cpnt], blend_d);
+			gp->base[2][cpnt] = a + blend_e - blend_c;
+			gp->lo[2][cpnt] = MIN(gp->lo[1][cpnt], blend_e);
+			gp->hi[2][cpnt] = MAX(gp->hi[1][cpnt], blend_e);
+		}
+#endif
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+			gp->qdiv[cpnt] = QuantDivisor[qlevel[cpnt]];
 		break;
+	}
 	case PT_LEFT:
-		p = a;    // First pixel of group
-		if ((hPos % SAMPLES_PER_UNIT)==1)   // Second pixel of group
-			p = CLAMP(a + (dsc_state->quantizedResidual[cpnt][0] * QuantDivisor[qLevel]), 0, (1<<dsc_state->cpntBitDepth[cpnt])-1);
-		else if((hPos % SAMPLES_PER_UNIT)==2)  // Third pixel of group
-			p = CLAMP(a + (dsc_state->quantizedResidual[cpnt][0] + dsc_state->quantizedResidual[cpnt][1])*QuantDivisor[qLevel],
-						0, (1<<dsc_state->cpntBitDepth[cpnt])-1);
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			int a = currLine[cpnt][idx-1];
+
+			gp->base[0][cpnt] = gp->lo[0][cpnt] = gp->hi[0][cpnt] = a;    // First pixel of group
+			for (k=1; k<PIXELS_PER_GROUP; ++k)
+			{
+				gp->base[k][cpnt] = a;
+				gp->lo[k][cpnt] = 0;
+				gp->hi[k][cpnt] = (1<<dsc_state->cpntBitDepth[cpnt])-1;
+			}
+			gp->qdiv[cpnt] = QuantDivisor[qlevel[cpnt]];
+		}
 		break;
 	default:  // PT_BLOCK+ofs = BLOCK predictor, starts at -1
 		// *MODEL NOTE* MN_BLOCK_PRED
 		bp_offset = (int)predType - (int)PT_BLOCK;
-		p = currLine[MAX(hPos + PADDING_LEFT - 1 - bp_offset,0)];
+		gp->leftChain = (bp_offset == 0);
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			for (k=0; k<PIXELS_PER_GROUP; ++k)
+				gp->base[k][cpnt] = gp->lo[k][cpnt] = gp->hi[k][cpnt] = currLine[cpnt][MAX(hPos + k + PADDING_LEFT - 1 - bp_offset,0)];
+			gp->qdiv[cpnt] = 0;
+		}
 		break;
 	}
+	for (k=0; k<PIXELS_PER_GROUP; ++k)
+		gp->base[k][NUM_COMPONENTS] = gp->lo[k][NUM_COMPONENTS] = gp->hi[k][NUM_COMPONENTS] = 0;
+	gp->qdiv[NUM_COMPONENTS] = 0;
+}
+
+
+//! Get the predicted samples for one pixel of a group
+/*! \param dsc_state DSC state structure (the group's quantized residuals for the earlier pixels must be set)
+	\param gp        Group prediction from GroupPredictSetup()
+	\param currLine  Samples from current (reconstructed) line for each component
+	\param hPos      Horizontal position within slice of the pixel
+	\param pred      Returned predicted sample for each component (PRED_LANES entries) */
+static DSC_FORCEINLINE void GroupPredict(dsc_state_t *dsc_state, const group_pred_t *gp, int **currLine, int hPos, int *pred)
+{
+	int k = hPos % SAMPLES_PER_UNIT;
+	int cpnt;
+
+	if (gp->leftChain && k)
+	{
+		// Vector -1 predicts from the pixel just reconstructed
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+			pred[cpnt] = currLine[cpnt][hPos + PADDING_LEFT - 1];
+		return;
+	}
+	{
+#if defined(__SSE4_1__)
+		__m128i r = _mm_setzero_si128();
+
+		if (k > 0)
+			r = _mm_setr_epi32(dsc_state->quantizedResidual[0][0], dsc_state->quantizedResidual[1][0], dsc_state->quantizedResidual[2][0], 0);
+		if (k > 1)
+			r = _mm_add_epi32(r, _mm_setr_epi32(dsc_state->quantizedResidual[0][1], dsc_state->quantizedResidual[1][1], dsc_state->quantizedResidual[2][1], 0));
+		r = _mm_add_epi32(_mm_loadu_si128((const __m128i *)gp->base[k]), _mm_mullo_epi32(r, _mm_loadu_si128((const __m128i *)gp->qdiv)));
+		r = _mm_min_epi32(_mm_max_epi32(r, _mm_loadu_si128((const __m128i *)gp->lo[k])), _mm_loadu_si128((const __m128i *)gp->hi[k]));
+		_mm_storeu_si128((__m128i *)pred, r);
+#else
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			int r = 0;
+
+			if (k > 0)
+				r += dsc_state->quantizedResidual[cpnt][0];
+			if (k > 1)
+				r += dsc_state->quantizedResidual[cpnt][1];
+			pred[cpnt] = CLAMP(gp->base[k][cpnt] + r * gp->qdiv[cpnt], gp->lo[k][cpnt], gp->hi[k][cpnt]);
+		}
+#endif
+	}
+}
+
+
+#if defined(__SSE4_1__)
+//! Shift each component lane by its quantization level (lane 0 is luma, the others share the chroma qlevel)
+/*! \param x         Values to shift
+	\param gq        Quantizer settings
+	\param left      1 for a left shift, 0 for an arithmetic right shift
+	\return          Shifted values */
+static DSC_FORCEINLINE __m128i ShiftLanes(__m128i x, const group_quant_t *gq, int left)
+{
+#if defined(__AVX2__)
+	__m128i ql = _mm_loadu_si128((const __m128i *)gq->qlevel);
+
+	return (left ? _mm_sllv_epi32(x, ql) : _mm_srav_epi32(x, ql));
+#else
+	__m128i luma = _mm_cvtsi32_si128(gq->qlevel[0]);
+	__m128i chroma = _mm_cvtsi32_si128(gq->qlevel[1]);
+
+	if (left)
+		return (_mm_blend_epi16(_mm_sll_epi32(x, luma), _mm_sll_epi32(x, chroma), 0xfc));
+	return (_mm_blend_epi16(_mm_sra_epi32(x, luma), _mm_sra_epi32(x, chroma), 0xfc));
+#endif
+}
+#endif
+
+
+//! Encoder kernel to quantize and reconstruct all components of a pixel
+/*! Computes the DPCM residual and the midpoint residual (limited to the maximum residual size), both
+    reconstructions, and updates the group's max errors for both.
+	\param bpc       Bits per component
+	\param dsc_state DSC state structure (residuals, midpoint reconstruction and max errors are modified)
+	\param gq        Quantizer settings for the group
+	\param hPos      Horizontal position within slice of the pixel
+	\param sampModCnt Index of the pixel within the group
+	\param pred      Predicted samples (PRED_LANES entries)
+	\param recon     Returned reconstructed samples (PRED_LANES entries) */
+static DSC_FORCEINLINE void QuantizePixel(int bpc, dsc_state_t *dsc_state, const group_quant_t *gq, int hPos, int sampModCnt, const int *pred, int *recon)
+{
+	int err_shift = bpc - 8;
+	int q[PRED_LANES], q_mid[PRED_LANES], mid_recon[PRED_LANES], err[PRED_LANES], mid_err[PRED_LANES];
+	int cpnt;
+#if defined(__SSE4_1__)
+	__m128i actual, p, e, eq, em, rq, rm, zero, maxval;
+	__m128i offset;
+
+	// *MODEL NOTE* MN_ENC_QUANTIZATION
+	actual = _mm_setr_epi32(dsc_state->origLine[0][hPos+PADDING_LEFT], dsc_state->origLine[1][hPos+PADDING_LEFT],
+		dsc_state->origLine[2][hPos+PADDING_LEFT], 0);
+	p = _mm_loadu_si128((const __m128i *)pred);
+	offset = _mm_setr_epi32(QuantOffset[gq->qlevel[0]], QuantOffset[gq->qlevel[1]], QuantOffset[gq->qlevel[2]], 0);
+	zero = _mm_setzero_si128();
+	maxval = _mm_loadu_si128((const __m128i *)gq->maxval);
+
+	// QuantizeResidual(): sign(e) * ((|e| + QuantOffset) >> qlevel)
+	e = _mm_sub_epi32(actual, p);
+	eq = _mm_sign_epi32(ShiftLanes(_mm_add_epi32(_mm_abs_epi32(e), offset), gq, 0), e);
+	e = _mm_sub_epi32(actual, _mm_loadu_si128((const __m128i *)gq->midpoint));
+	em = _mm_sign_epi32(ShiftLanes(_mm_add_epi32(_mm_abs_epi32(e), offset), gq, 0), e);
+	em = _mm_min_epi32(_mm_max_epi32(em, _mm_loadu_si128((const __m128i *)gq->midMin)), _mm_loadu_si128((const __m128i *)gq->midMax));
+
+	// *MODEL NOTE* MN_IQ_RECON
+	rq = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(p, ShiftLanes(eq, gq, 1)), zero), maxval);
+	rm = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)gq->midpoint), ShiftLanes(em, gq, 1)), zero), maxval);
+
+	_mm_storeu_si128((__m128i *)q, eq);
+	_mm_storeu_si128((__m128i *)q_mid, em);
+	_mm_storeu_si128((__m128i *)recon, rq);
+	_mm_storeu_si128((__m128i *)mid_recon, rm);
+	_mm_storeu_si128((__m128i *)err, _mm_srai_epi32(_mm_abs_epi32(_mm_sub_epi32(actual, rq)), err_shift));
+	_mm_storeu_si128((__m128i *)mid_err, _mm_srai_epi32(_mm_abs_epi32(_mm_sub_epi32(actual, rm)), err_shift));
+#else
+	for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+	{
+		int actual = dsc_state->origLine[cpnt][hPos+PADDING_LEFT];
+		int qlevel = gq->qlevel[cpnt];
+
+		q[cpnt] = QuantizeResidual(actual - pred[cpnt], qlevel);
+
+		// Midpoint residuals need to be bounded to BPC-QP in size, this is for some corner cases
+		q_mid[cpnt] = CLAMP(QuantizeResidual(actual - gq->midpoint[cpnt], qlevel), gq->midMin[cpnt], gq->midMax[cpnt]);
+
+		// *MODEL NOTE* MN_IQ_RECON
+		recon[cpnt] = CLAMP(pred[cpnt] + (q[cpnt] << qlevel), 0, gq->maxval[cpnt]);
+		mid_recon[cpnt] = CLAMP(gq->midpoint[cpnt] + (q_mid[cpnt] << qlevel), 0, gq->maxval[cpnt]);
+		err[cpnt] = abs(actual - recon[cpnt]) >> err_shift;
+		mid_err[cpnt] = abs(actual - mid_recon[cpnt]) >> err_shift;
+	}
+#endif
 
-	return p;
+	for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+	{
+		dsc_state->quantizedResidual[cpnt][sampModCnt] = q[cpnt];
+		dsc_state->quantizedResidualMid[cpnt][sampModCnt] = q_mid[cpnt];
+		// Encoder always computes midpoint value in case any residual size >= BPC - QP
+		dsc_state->midpointRecon[cpnt][sampModCnt] = mid_recon[cpnt];
+		dsc_state->maxError[cpnt] = (sampModCnt==0) ? err[cpnt] : MAX(dsc_state->maxError[cpnt], err[cpnt]);
+		dsc_state->maxMidError[cpnt] = (sampModCnt==0) ? mid_err[cpnt] : MAX(dsc_state->maxMidError[cpnt], mid_err[cpnt]);
+	}
 }
 
 
@@ -325,31 +527,136 @@ void HistoryLookup(dsc_cfg_t *dsc_cfg, dsc_state_t* dsc_state, int entry, unsign
 		p[1] = dsc_state->prevLine[1][hPos+(entry-reserved)+PADDING_LEFT - (ICH_PIXELS_ABOVE/2)];
 		p[2] = dsc_state->prevLine[2][hPos+(entry-reserved)+PADDING_LEFT - (ICH_PIXELS_ABOVE/2)];
 	} else {
-		p[0] = dsc_state->history.pixels[0][entry];
-		p[1] = dsc_state->history.pixels[1][entry];
-		p[2] = dsc_state->history.pixels[2][entry];
+		p[0] = ICH_UNPACK(dsc_state->history.pixels[entry], 0);
+		p[1] = ICH_UNPACK(dsc_state->history.pixels[entry], 1);
+		p[2] = ICH_UNPACK(dsc_state->history.pixels[entry], 2);
+	}
+}
+
+
+//! Take a snapshot of the ICH entries (including the upper line entries) that apply to the current group
+/*! The history and the previous line only change between groups, so the encoder searches this copy for
+    every pixel of the group instead of calling HistoryLookup() for each entry.
+    \param dsc_cfg   DSC configuration structure
+    \param dsc_state DSC state structure 
+	\param hPos      Current horizontal position within slice
+	\param vPos      Current vertical position within slice */
+static void IchSnapshot(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int hPos, int vPos)
+{
+	int j, cpnt;
+	int reserved = ICH_SIZE-ICH_PIXELS_ABOVE;
+	int *above;
+
+	for (j=0; j<ICH_SIZE; ++j)
+		dsc_state->ichSnapValid[j] = ((dsc_state->history.valid >> j) & 1) ? -1 : 0;
+	for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		for (j=0; j<reserved; ++j)
+			dsc_state->ichSnapPixels[cpnt][j] = (short)ICH_UNPACK(dsc_state->history.pixels[j], cpnt);
+
+	// Same center-of-group reference and edge clamping as HistoryLookup()
+	hPos = (hPos/PIXELS_PER_GROUP)*PIXELS_PER_GROUP + (PIXELS_PER_GROUP/2);
+	hPos = CLAMP(hPos, ICH_PIXELS_ABOVE/2, dsc_cfg->slice_width-1-(ICH_PIXELS_ABOVE/2));
+	for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+	{
+		above = dsc_state->prevLine[cpnt] + hPos + PADDING_LEFT - (ICH_PIXELS_ABOVE/2);
+		for (j=reserved; j<ICH_SIZE; ++j)
+			dsc_state->ichSnapPixels[cpnt][j] = (short)((vPos==0) ? (int)ICH_UNPACK(dsc_state->history.pixels[j], cpnt) : above[j-reserved]);
+	}
+}
+
+
+//! Search the ICH snapshot for an original pixel
+/*! \param dsc_state DSC state structure 
+	\param orig      3-element array containing the component samples for the pixel to be matched
+	\param max_qerr  3-element array containing the maximum quantization error for each component
+	\param best      Returns the valid entry with the lowest weighted SAD (first one on ties, 99 if none)
+	\return          1 if any valid entry is within max_qerr for all components */
+static int IchSearch(dsc_state_t *dsc_state, unsigned int *orig, int *max_qerr, int *best)
+{
+	int j;
+	int hit = 0;
+	int lowest_sad = 9999;   // Initialize to large, illegal values
+
+	*best = 99;
+#if defined(__SSE4_1__)
+	{
+		__m128i o[NUM_COMPONENTS], q[NUM_COMPONENTS];
+		__m128i valid, d0, d1, d2, within, wsad, minpos;
+		__m128i no_match = _mm_set1_epi16(0x7fff);
+		int cpnt, sad;
+
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			o[cpnt] = _mm_set1_epi16((short)orig[cpnt]);
+			q[cpnt] = _mm_set1_epi16((short)max_qerr[cpnt]);
+		}
+		for (j=0; j<ICH_SIZE; j+=8)
+		{
+			valid = _mm_loadu_si128((const __m128i *)&dsc_state->ichSnapValid[j]);
+			d0 = _mm_abs_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)&dsc_state->ichSnapPixels[0][j]), o[0]));
+			d1 = _mm_abs_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)&dsc_state->ichSnapPixels[1][j]), o[1]));
+			d2 = _mm_abs_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)&dsc_state->ichSnapPixels[2][j]), o[2]));
+
+			within = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi16(d0, q[0]), _mm_cmpgt_epi16(d1, q[1])), _mm_cmpgt_epi16(d2, q[2]));
+			within = _mm_andnot_si128(within, valid);
+			hit |= (_mm_movemask_epi8(within) != 0);
+
+			// weighted SAD is at most 4*8191, so it fits in 16 bits
+			wsad = _mm_add_epi16(_mm_add_epi16(d0, d0), _mm_add_epi16(d1, d2));
+			wsad = _mm_or_si128(_mm_and_si128(valid, wsad), _mm_andnot_si128(valid, no_match));
+			minpos = _mm_minpos_epu16(wsad);   // Lowest value and its first index
+			sad = _mm_extract_epi16(minpos, 0);
+			if (lowest_sad > sad)
+			{
+				lowest_sad = sad;
+				*best = j + _mm_extract_epi16(minpos, 1);
+			}
+		}
+	}
+#else
+	{
+		int diff0, diff1, diff2, weighted_sad;
+
+		for (j=0; j<ICH_SIZE; ++j)
+		{
+			if (!dsc_state->ichSnapValid[j])
+				continue;
+			diff0 = abs((int)dsc_state->ichSnapPixels[0][j] - (int)orig[0]);
+			diff1 = abs((int)dsc_state->ichSnapPixels[1][j] - (int)orig[1]);
+			diff2 = abs((int)dsc_state->ichSnapPixels[2][j] - (int)orig[2]);
+			if ((diff0 <= max_qerr[0]) && (diff1 <= max_qerr[1]) && (diff2 <= max_qerr[2]))
+				hit = 1;
+			weighted_sad = 2*diff0 + diff1 + diff2;
+			if (lowest_sad > weighted_sad)  // Find lowest SAD
+			{
+				lowest_sad = weighted_sad;
+				*best = j;
+			}
+		}
 	}
+#endif
+	return (hit);
 }
 
 
 //! Encoder function to determine whether or not the current sample is within the quantization error of any ICH entry 
-/*! \param dsc_cfg   DSC configuration structure
+/*! If it is, also selects the history entry with the lowest weighted SAD for the sample.
+    \param dsc_cfg   DSC configuration structure
     \param dsc_state DSC state structure 
 	\param hPos      Current horizontal position within slice
 	\param vPos      Current vertical position within slice
 	\param qp        Quantization parameter for current group
 	\param sampModCnt Index of current pixel within group 
+	\param best_idx  Returns the ICH index the encoder selects (only set if the sample is within the quantization error)
 	\return          1 indicates that the sample is within the quantization error */
-int IsOrigWithinQerr(dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, int hPos, int vPos, int qp, int sampModCnt)
+int IsOrigWithinQerr(dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, int hPos, int vPos, int qp, int sampModCnt, int *best_idx)
 {
 	int max_qerr[NUM_COMPONENTS];
-	int hit;
-	int diff, absdiff;
-	unsigned int orig;
+	int best;
+	unsigned int orig[NUM_COMPONENTS];
 	int cpnt;
-	unsigned int ich_pixel[NUM_COMPONENTS];
 	int modified_qp;
-	int i, j;
+	int group;
 
 	// *MODEL NOTE* MN_ENC_ICH_PIXEL_CHECK_QERR
 	dsc_state->origWithinQerr[sampModCnt] = 0;  // Assume for now that pixel is not within QErr
@@ -372,127 +679,83 @@ int IsOrigWithinQerr(dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, int hPos, int v
 	if (dsc_state->vPos>0)
 	{
 		// UL/U/UR always valid for non-first-lines
-		for (i=ICH_SIZE-ICH_PIXELS_ABOVE; i<ICH_SIZE; ++i)
-			dsc_state->history.valid[i] = 1;
+		dsc_state->history.valid |= ~((1u << (ICH_SIZE-ICH_PIXELS_ABOVE)) - 1);
 	}
 
-	hit = 0;
-	for (j=0; j<ICH_SIZE; ++j)
+	group = vPos * dsc_cfg->slice_width + hPos / PIXELS_PER_GROUP;
+	if (dsc_state->ichSnapGroup != group)
 	{
-		if (!dsc_state->history.valid[j])
-			continue;
-		hit = 1;
-		HistoryLookup(dsc_cfg, dsc_state, j, ich_pixel, hPos, (vPos==0));  // CLAMP is to minimize duplicates among UL/U/UR
-		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
-		{
-			orig = dsc_state->origLine[cpnt][hPos+PADDING_LEFT];
-			diff = (int)ich_pixel[cpnt] - (int)orig;
-			absdiff = abs(diff);
-			if (absdiff > max_qerr[cpnt])
-				hit = 0;
-		}
-		if (hit)
-			break;  // Found one
+		IchSnapshot(dsc_cfg, dsc_state, hPos, vPos);
+		dsc_state->ichSnapGroup = group;
 	}
-	if (!hit)
+
+	for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		orig[cpnt] = dsc_state->origLine[cpnt][hPos+PADDING_LEFT];
+	if (!IchSearch(dsc_state, orig, max_qerr, &best))
 		return(0);  // Can't use, one pixel was a total miss
 
+	// *MODEL NOTE* MN_ENC_ICH_IDX_SELECT
+	*best_idx = best;
 	dsc_state->origWithinQerr[sampModCnt] = 1;
 	return (1);
 }
 
 
+//! Find the history entries that hold a given packed pixel
+/*! \param dsc_state DSC state structure 
+	\param key       Packed pixel to look for
+	\param n         Number of entries to compare (starting with the MRU)
+	\return          Bit i is set if entry i holds the pixel (valid or not) */
+static unsigned int HistoryMatchMask(dsc_state_t *dsc_state, unsigned long long key, int n)
+{
+	unsigned int mask = 0;
+	int j = 0;
+#if defined(__AVX2__)
+	__m256i k4 = _mm256_set1_epi64x((long long)key);
+
+	for (; j+4<=n; j+=4)
+		mask |= (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(
+			_mm256_loadu_si256((const __m256i *)&dsc_state->history.pixels[j]), k4))) << j;
+#elif defined(__SSE4_1__)
+	__m128i k2 = _mm_set1_epi64x((long long)key);
+
+	for (; j+2<=n; j+=2)
+		mask |= (unsigned int)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(
+			_mm_loadu_si128((const __m128i *)&dsc_state->history.pixels[j]), k2))) << j;
+#endif
+	for (; j<n; ++j)
+		mask |= (unsigned int)(dsc_state->history.pixels[j] == key) << j;
+	return (mask);
+}
+
+
 //! Update the ICH state based on a reconstructed pixel
-/*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state DSC state structure 
+/*! \param dsc_state DSC state structure 
 	\param recon     A 3-element array containing the components of the reconstructed pixel */
-void UpdateHistoryElement(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned int *recon)
+void UpdateHistoryElement(dsc_state_t *dsc_state, unsigned int *recon)
 {
-	int hit, j;
 	int loc;
-	int cpnt;
-	unsigned int ich_pixel[NUM_COMPONENTS];
 	int reserved;
+	unsigned int range, candidates, shifted;
+	unsigned long long key;
 
 	// *MODEL NOTE* MN_ICH_UPDATE
 	reserved = (dsc_state->vPos==0) ? ICH_SIZE : (ICH_SIZE-ICH_PIXELS_ABOVE);  // space for UL, U, UR
-
-	// Update the ICH with recon as the MRU
-	hit = 0;
-	loc = reserved-1;  // If no match, delete LRU
-	for (j=0; j<reserved; ++j)
-	{
-		if (!dsc_state->history.valid[j])  // Can replace any empty entry
-		{
-			loc = j;
-			break;
-		}
-		HistoryLookup(dsc_cfg, dsc_state, j, ich_pixel, dsc_state->hPos, (dsc_state->vPos==0));  // Specific hPos within group is not critical 
-																					// since hits against UL/U/UR don't have specific detection
-		hit = 1;
-		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
-		{
-			if (ich_pixel[cpnt] != recon[cpnt])
-				hit = 0;
-		}
-		if (hit && ((dsc_state->isEncoder && dsc_state->ichSelected) || (!dsc_state->isEncoder && dsc_state->prevIchSelected)))
-		{
-			loc = j;
-			break;  // Found one
-		}
-	}
-
-	for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
-	{
-		// Delete from current position (or delete LRU)
-		for (j=loc; j>0; --j)
-		{
-			dsc_state->history.pixels[cpnt][j] = dsc_state->history.pixels[cpnt][j-1];	
-			dsc_state->history.valid[j] = dsc_state->history.valid[j-1];
-		}
-
-		// Insert as most recent
-		dsc_state->history.pixels[cpnt][0] = recon[cpnt];
-		dsc_state->history.valid[0] = 1;
-	}
-}
-
-
-//! Encoder function to select the best history entry & return the corresponding index
-/*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state DSC state structure 
-	\param hPos      Horizontal position within slice
-	\param orig      3-element array containing the component samples for the pixel to be matched
-	\return          The ICH index that the encoder selects */
-int PickBestHistoryValue(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int hPos, unsigned int *orig)
-{
-	int j, best, lowest_sad;
-	int diff0, diff1, diff2, weighted_sad;
-	unsigned int ich_pixel[NUM_COMPONENTS];
-
-	// Initialize to large, illegal values
-	lowest_sad = 9999;
-	best = 99;
-
-	// *MODEL NOTE* MN_ENC_ICH_IDX_SELECT
-	for (j=0; j<ICH_SIZE; ++j)
-	{
-		if (!dsc_state->history.valid[j])
-			continue;
-		weighted_sad = 0;
-		HistoryLookup(dsc_cfg, dsc_state, j, ich_pixel, hPos, (dsc_state->vPos==0));  // -2 to preserve U/UL/UR at right edge
-		diff0 = (int)ich_pixel[0] - (int)orig[0];
-		diff1 = (int)ich_pixel[1] - (int)orig[1];
-		diff2 = (int)ich_pixel[2] - (int)orig[2];
-		weighted_sad += 2*abs(diff0) + abs(diff1) + abs(diff2);
-		if (lowest_sad > weighted_sad)  // Find lowest SAD
-		{
-			lowest_sad = weighted_sad;
-			best = j;
-		}
-	}
-
-	return (best);
+	range = (reserved == 32) ? 0xffffffffu : ((1u << reserved) - 1);
+	key = ICH_PACK(recon);
+
+	// Update the ICH with recon as the MRU.  The entry to replace is the first empty entry, or if a
+	// valid entry before it matches (and ICH was used), the first match.  Otherwise, delete the LRU.
+	candidates = ~dsc_state->history.valid & range;
+	if ((dsc_state->isEncoder && dsc_state->ichSelected) || (!dsc_state->isEncoder && dsc_state->prevIchSelected))
+		candidates |= HistoryMatchMask(dsc_state, key, reserved) & dsc_state->history.valid & range;
+	loc = candidates ? ctz32(candidates) : reserved-1;
+
+	// Delete from current position (or delete LRU) and insert as most recent
+	memmove(&dsc_state->history.pixels[1], &dsc_state->history.pixels[0], loc * sizeof(unsigned long long));
+	dsc_state->history.pixels[0] = key;
+	shifted = (loc == 31) ? 0xffffffffu : ((2u << loc) - 1);   // Entries 0 to loc move down by one
+	dsc_state->history.valid = (dsc_state->history.valid & ~shifted) | ((dsc_state->history.valid << 1) & shifted) | 1;
 }
 
 
@@ -500,12 +763,10 @@ int PickBestHistoryValue(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int hPos, u
 /*! \param dsc_cfg   DSC configuration structure
     \param dsc_state DSC state structure 
 	\param currLine  Reconstructed samples for current line
-	\param sampModCnt Index of which pixel within group
 	\param hPos      Horizontal position within slice (note that update uses pixels from one group prior)
 	\param vPos      Vertical position within slice */
-void UpdateICHistory(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int **currLine, int sampModCnt, int hPos, int vPos)
+void UpdateICHistory(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int **currLine, int hPos, int vPos)
 {
-	int i;
 	int cpnt;
 	unsigned int p[NUM_COMPONENTS];
 	int hPos_prev_group;
@@ -518,13 +779,11 @@ void UpdateICHistory(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int **currLine,
 	{
 		if (vPos == 0)            // Beginning of slice
 		{
-			for (i=0; i<ICH_SIZE; ++i)
-				dsc_state->history.valid[i] = 0;
+			dsc_state->history.valid = 0;
 		}
 		else if (dsc_cfg->slice_width != dsc_cfg->pic_width)   // Multiple slices per line
 		{
-			for (i=0; i<(ICH_SIZE - ICH_PIXELS_ABOVE); ++i)
-				dsc_state->history.valid[i] = 0;
+			dsc_state->history.valid &= ~((1u << (ICH_SIZE - ICH_PIXELS_ABOVE)) - 1);
 		}
 	}
 
@@ -538,15 +797,14 @@ void UpdateICHistory(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int **currLine,
 		p[cpnt] = currLine[cpnt][hPos_prev_group + PADDING_LEFT];
 
 	// Update ICH accordingly
-	UpdateHistoryElement(dsc_cfg, dsc_state, p);
+	UpdateHistoryElement(dsc_state, p);
 }
 
 
 //! Encoder function to update the reconstructed samples & output picture if ICH is selected
-/*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state DSC state structure 
+/*! \param dsc_state DSC state structure 
 	\param currLine  Current line reconstructed samples (modified) */
-void UseICHistory(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int **currLine)
+void UseICHistory(dsc_state_t *dsc_state, int **currLine)
 {
 	int i;
 	int cpnt;
@@ -620,93 +878,171 @@ int FindMidpoint(dsc_state_t *dsc_state, int cpnt, int qlevel)
 }
 
 
+//! Compute the 3-pixel SAD's for every block prediction vector for one component of a line
+/*! \param red       Reduced samples for the line (red[-1-BP_RANGE..-1] hold the left padding)
+	\param width     Number of samples in the line
+	\param shift     Right shift applied to each absolute difference before clamping to 6 bits
+	\param blk_sad   Output: BP_RANGE SAD's for each 3-pixel block */
+static void BpBlockSads(const short *red, int width, int shift, short *blk_sad)
+{
+	int hPos, blk, i, n;
+	int candidate_vector;  // a value of 0 maps to -1, 2 maps to -3, etc.
+#if defined(__AVX2__)
+	// Lane j holds the difference against red[hPos-16+j], which is candidate vector 15-j
+	__m256i cur, ref, d, acc;
+	__m128i sh = _mm_cvtsi32_si128(shift);
+	__m256i maxdiff = _mm256_set1_epi16(0x3f);
+	short lanes[16];
+
+	for (blk = 0; blk*PRED_BLK_SIZE < width; ++blk)
+	{
+		acc = _mm256_setzero_si256();
+		n = MIN(PRED_BLK_SIZE, width - blk*PRED_BLK_SIZE);
+		for (i=0; i<n; ++i)
+		{
+			hPos = blk*PRED_BLK_SIZE + i;
+			cur = _mm256_set1_epi16(red[hPos]);
+			ref = _mm256_loadu_si256((const __m256i *)(red + hPos - 16));
+			d = _mm256_abs_epi16(_mm256_sub_epi16(cur, ref));
+			d = _mm256_min_epi16(_mm256_srl_epi16(d, sh), maxdiff);
+			acc = _mm256_add_epi16(acc, d);
+		}
+		_mm256_storeu_si256((__m256i *)lanes, acc);
+		for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
+			blk_sad[blk*BP_RANGE + candidate_vector] = lanes[15-candidate_vector];
+	}
+#elif defined(__SSE4_1__)
+	// Lane j of the lo/hi vector holds the difference against red[hPos-8+j]/red[hPos-16+j]
+	__m128i cur, d, acc_lo, acc_hi;
+	__m128i sh = _mm_cvtsi32_si128(shift);
+	__m128i maxdiff = _mm_set1_epi16(0x3f);
+	short lanes[16];
+
+	for (blk = 0; blk*PRED_BLK_SIZE < width; ++blk)
+	{
+		acc_lo = acc_hi = _mm_setzero_si128();
+		n = MIN(PRED_BLK_SIZE, width - blk*PRED_BLK_SIZE);
+		for (i=0; i<n; ++i)
+		{
+			hPos = blk*PRED_BLK_SIZE + i;
+			cur = _mm_set1_epi16(red[hPos]);
+			d = _mm_abs_epi16(_mm_sub_epi16(cur, _mm_loadu_si128((const __m128i *)(red + hPos - 8))));
+			acc_lo = _mm_add_epi16(acc_lo, _mm_min_epi16(_mm_srl_epi16(d, sh), maxdiff));
+			d = _mm_abs_epi16(_mm_sub_epi16(cur, _mm_loadu_si128((const __m128i *)(red + hPos - 16))));
+			acc_hi = _mm_add_epi16(acc_hi, _mm_min_epi16(_mm_srl_epi16(d, sh), maxdiff));
+		}
+		_mm_storeu_si128((__m128i *)lanes, acc_hi);
+		_mm_storeu_si128((__m128i *)(lanes + 8), acc_lo);
+		for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
+			blk_sad[blk*BP_RANGE + candidate_vector] = lanes[15-candidate_vector];
+	}
+#else
+	int pixdiff;
+	short *sad;
+
+	for (blk = 0; blk*PRED_BLK_SIZE < width; ++blk)
+	{
+		sad = blk_sad + blk*BP_RANGE;
+		for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
+			sad[candidate_vector] = 0;
+		n = MIN(PRED_BLK_SIZE, width - blk*PRED_BLK_SIZE);
+		for (i=0; i<n; ++i)
+		{
+			hPos = blk*PRED_BLK_SIZE + i;
+			for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
+			{
+				pixdiff = red[hPos] - red[hPos - 1 - candidate_vector];
+				pixdiff = ABS(pixdiff);
+				sad[candidate_vector] += MIN(pixdiff >> shift, 0x3f);
+			}
+		}
+	}
+#endif
+}
+
+
 //! Function to decide block vs. MAP & which block prediction vector to use for the next line
-/*! \param dsc_cfg   DSC configuration structure
+/*! Runs once the whole line has been reconstructed and computes the best predictor for each
+    block of the NEXT line.
+    \param dsc_cfg   DSC configuration structure
     \param dsc_state DSC state structure
-	\param cpnt      Component index
-	\param currLine  Current line's reconstructed samples
-	\param hPos      Horizontal position in slice
-	\param recon_x   Current reconstructed sample value */
-void BlockPredSearch(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int **currLine, int hPos, int recon_x)
+	\param currLine  Current line's reconstructed samples, already reduced to line buffer precision */
+void BlockPredSearch(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int **currLine)
 {
 	int i, j;
+	int cpnt;
+	int hPos, blk;
+	int width = dsc_cfg->slice_width;
 	int candidate_vector;  // a value of 0 maps to -1, 2 maps to -3, etc.
-	int pred_x;
-	int pixel_mod_cnt;
 	int min_err;
 	PRED_TYPE min_pred;
 	int cursamp;
 	int pixdiff;
 	int bp_sads[BP_RANGE];
-	int modified_abs_diff;
+	int edge_thresh;
+	short *red;
 
-	// This function runs right after a reconstructed value is determined and computes the best predictor to use for the NEXT line.
-	// An implementation could run the block prediction search at any time after that up until the point at which the selection is needed.
+	// An implementation could run the block prediction search at any time after a reconstructed value is
+	// determined up until the point at which the selection is needed.
 	// *MODEL NOTE* MN_BP_SEARCH
 
-	if (hPos == 0)
+	if (!dsc_cfg->block_pred_enable)
 	{
-		// Reset prediction accumulators every line
-		dsc_state->bpCount = 0;
-		dsc_state->lastEdgeCount = 10;  // Arbitrary large value as initial condition
-		for (i=0; i<NUM_COMPONENTS; ++i)
-		{
-			for (j=0; j<BP_SIZE; ++j)
-			{
-				for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
-					dsc_state->lastErr[i][j][candidate_vector] = 0;
-			}
-		}
+		// bpCount can never reach 3, so every block selects MAP
+		for (blk = 0; blk*PRED_BLK_SIZE < width; ++blk)
+			dsc_state->prevLinePred[blk] = PT_MAP;
+		return;
 	}
 
-	// Last edge count check - looks at absolute differences between adjacent pixels
-	//   - Don't use block prediction if the content is basically flat
-	pixdiff = SampToLineBuf(dsc_cfg, dsc_state, recon_x, cpnt) - 
-		      SampToLineBuf(dsc_cfg, dsc_state, currLine[cpnt][hPos+PADDING_LEFT-1], cpnt);
-	pixdiff = ABS(pixdiff);
-	if (cpnt == 0)
-		dsc_state->edgeDetected = 0;
-	if (pixdiff > (BP_EDGE_STRENGTH << (dsc_cfg->bits_per_component-8)))
-		dsc_state->edgeDetected = 1;
-	if (cpnt == NUM_COMPONENTS-1)
+	// HW uses previous line's reconstructed samples, which may be bit-reduced
+	for (cpnt = 0; cpnt < NUM_COMPONENTS; ++cpnt)
 	{
-		if (dsc_state->edgeDetected)
-			dsc_state->lastEdgeCount = 0;
-		else
-			dsc_state->lastEdgeCount++;
+		red = dsc_state->bpLine[cpnt] + BP_LINE_PAD;
+		for (i = -PADDING_LEFT; i < width; ++i)
+			red[i] = (short)currLine[cpnt][i + PADDING_LEFT];
+		for (i = -BP_LINE_PAD; i < -PADDING_LEFT; ++i)
+			red[i] = red[-PADDING_LEFT];   // Block predictor clamps to the start of the line buffer
+		BpBlockSads(red, width, dsc_state->cpntBitDepth[cpnt] - 7, dsc_state->bpBlockSad[cpnt]);
 	}
 
-	// The BP
-	cursamp = (hPos/PRED_BLK_SIZE) % BP_SIZE;
+	// Reset prediction accumulators every line
+	dsc_state->bpCount = 0;
+	dsc_state->lastEdgeCount = 10;  // Arbitrary large value as initial condition
+	for (i=0; i<NUM_COMPONENTS; ++i)
+		for (j=0; j<BP_SIZE; ++j)
+			for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
+				dsc_state->lastErr[i][j][candidate_vector] = 0;
 
-	pixel_mod_cnt = hPos % PRED_BLK_SIZE;
-	for ( candidate_vector=0; candidate_vector<BP_RANGE; candidate_vector++ ) {
-		if ( pixel_mod_cnt == 0 ) {			// predErr is summed over PRED_BLK_SIZE pixels
-			dsc_state->predErr[cpnt][candidate_vector] = 0;
+	edge_thresh = BP_EDGE_STRENGTH << (dsc_cfg->bits_per_component-8);
+	for (hPos = 0; hPos < width; ++hPos)
+	{
+		// Last edge count check - looks at absolute differences between adjacent pixels
+		//   - Don't use block prediction if the content is basically flat
+		dsc_state->edgeDetected = 0;
+		for (cpnt = 0; cpnt < NUM_COMPONENTS; ++cpnt)
+		{
+			red = dsc_state->bpLine[cpnt] + BP_LINE_PAD;
+			pixdiff = red[hPos] - red[hPos-1];
+			pixdiff = ABS(pixdiff);
+			if (pixdiff > edge_thresh)
+				dsc_state->edgeDetected = 1;
 		}
+		if (dsc_state->edgeDetected)
+			dsc_state->lastEdgeCount = 0;
+		else
+			dsc_state->lastEdgeCount++;
 
-		pred_x = SamplePredict( dsc_state, currLine[cpnt], currLine[cpnt], hPos, (PRED_TYPE)(candidate_vector+PT_BLOCK), 0, cpnt );
-
-		// HW uses previous line's reconstructed samples, which may be bit-reduced
-		pred_x = SampToLineBuf(dsc_cfg, dsc_state, pred_x, cpnt);
-		recon_x = SampToLineBuf(dsc_cfg, dsc_state, recon_x, cpnt);
-
-		pixdiff = recon_x - pred_x;
-		pixdiff = ABS(pixdiff);
-		modified_abs_diff = MIN(pixdiff>>(dsc_state->cpntBitDepth[cpnt] - 7), 0x3f);
-		// ABS differences are clamped to 6 bits each, predErr for 3 pixels is 8 bits
-		dsc_state->predErr[cpnt][candidate_vector] += modified_abs_diff;
-	}
+		if ((hPos % PRED_BLK_SIZE) != PRED_BLK_SIZE - 1)
+			continue;
 
-	if ( pixel_mod_cnt == PRED_BLK_SIZE - 1 ) 
-	{
 		// Track last 3 3-pixel SADs for each component (each is 7 bit)
-		for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
-			dsc_state->lastErr[cpnt][cursamp][candidate_vector] = dsc_state->predErr[cpnt][candidate_vector];
-
-		if (cpnt<NUM_COMPONENTS-1)
-			return;   // SAD is across all 3 components -- wait until we've processed all 3
+		blk = hPos / PRED_BLK_SIZE;
+		cursamp = blk % BP_SIZE;
+		for (cpnt = 0; cpnt < NUM_COMPONENTS; ++cpnt)
+			for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
+				dsc_state->lastErr[cpnt][cursamp][candidate_vector] = dsc_state->bpBlockSad[cpnt][blk*BP_RANGE + candidate_vector];
 
+		// SAD is across all 3 components
 		for (candidate_vector=0; candidate_vector<BP_RANGE; ++candidate_vector)
 		{
 			bp_sads[candidate_vector] = 0;
@@ -741,7 +1077,7 @@ void BlockPredSearch(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *
 			} 
 		}
 
-		if (dsc_cfg->block_pred_enable && (hPos>=9))  // Don't start algorithm until 10th pixel
+		if (hPos>=9)  // Don't start algorithm until 10th pixel
 		{
 			if (min_pred > PT_BLOCK)
 				dsc_state->bpCount++;
@@ -749,9 +1085,9 @@ void BlockPredSearch(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *
 				dsc_state->bpCount = 0;
 		}
 		if ((dsc_state->bpCount>=3) && (dsc_state->lastEdgeCount < BP_EDGE_COUNT))
-			dsc_state->prevLinePred[hPos/PRED_BLK_SIZE] = (PRED_TYPE)min_pred;
+			dsc_state->prevLinePred[blk] = (PRED_TYPE)min_pred;
 		else
-			dsc_state->prevLinePred[hPos/PRED_BLK_SIZE] = (PRED_TYPE)PT_MAP;
+			dsc_state->prevLinePred[blk] = (PRED_TYPE)PT_MAP;
 	}
 }
 
@@ -760,26 +1096,14 @@ void BlockPredSearch(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *
 /*! \param eq        Residual  */
 int FindResidualSize(int eq)
 {
-	int size_e;
-
-	// Find the size in bits of e
-	if(eq == 0) size_e = 0;
-	else if (eq >= -1 && eq <= 0) size_e = 1;
-	else if (eq >= -2 && eq <= 1) size_e = 2;
-	else if (eq >= -4 && eq <= 3) size_e = 3;
-	else if (eq >= -8 && eq <= 7) size_e = 4;
-	else if (eq >= -16 && eq <= 15) size_e = 5;
-	else if (eq >= -32 && eq <= 31) size_e = 6;
-	else if (eq >= -64 && eq <= 63) size_e = 7;
-	else if (eq >= -128 && eq <= 127) size_e = 8;
-	else if (eq >= -256 && eq <= 255) size_e = 9;
-	else if (eq >= -512 && eq <= 511) size_e = 10;
-	else if (eq >= -1024 && eq <= 1023) size_e = 11;
-	else if (eq >= -2048 && eq <= 2047) size_e = 12;
-	else if (eq >= -4096 && eq <= 4095) size_e = 13;
-	else size_e = 14;
-
-	return size_e;
+	unsigned int mag;
+
+	// Find the size in bits of e: the smallest n with -2^(n-1) <= eq < 2^(n-1), i.e. one more than the
+	// number of significant bits in eq (or ~eq if negative).  Sizes are capped at 14.
+	if (eq == 0)
+		return 0;
+	mag = (eq < 0) ? ~(unsigned int)eq : (unsigned int)eq;
+	return MIN(32 - clz32((mag << 1) | 1), 14);
 }
 
 
@@ -970,7 +1294,8 @@ void RateControl( dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int throttle_offse
 		printf("The RC model has overflowed.  To address this issue, please adjust the\n");
 		printf("min_QP and max_QP higher for the top-most ranges, or decrease the rc_buf_thresh\n");
 		printf("for those ranges.\n");
-		exit(1);
+		dsc_state->error = DSC_ERR_RC;
+		return;
 	}
 
 	// Add a group time of delay to RC calculation
@@ -1055,16 +1380,15 @@ void RateControl( dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int throttle_offse
 		printf( "Previous range info\n" );
 		printf( "  range min_qp:     %d\n", range_cfg->range_min_qp );
 		printf( "  range max_qp:     %d\n", range_cfg->range_max_qp );
-		exit(1);
+		dsc_state->error = DSC_ERR_BUFFER;
 	}
 }
 
 
 //! Predict size for next unit
-/*! \param dsc_cfg   DSC configuration structure
-    \param req_size  Array of required sizes for the samples in the unit
+/*! \param req_size  Array of required sizes for the samples in the unit
 	\return          Predicted size for next unit */
-int PredictSize(dsc_cfg_t *dsc_cfg, int *req_size)
+int PredictSize(int *req_size)
 {
 	int pred_size;
 
@@ -1166,7 +1490,7 @@ void VLCUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 	if ((cpnt == unit_to_send_fpos) && ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP) == 0) && 
 		(dsc_state->firstFlat >= 0))
 	{
-		if (dsc_state->masterQp >= SOMEWHAT_FLAT_QP_THRESH)
+		if (dsc_state->masterQp >= SOMEWHAT_FLAT_QP_THRESH(dsc_cfg->bits_per_component))
 			AddBits(dsc_cfg, dsc_state, cpnt, dsc_state->flatnessType, 1);
 		else
 			dsc_state->flatnessType = 0;
@@ -1216,6 +1540,7 @@ void VLCUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 
 	// Determine if all 3 pixels are withing the quantization error
 	dsc_state->ichSelected = 0;
+	dsc_state->ichSnapGroup = -1;
 	all_orig_within_qerr = 1;
 	for (i=0; i<PIXELS_PER_GROUP; ++i)
 		if (!dsc_state->origWithinQerr[i])
@@ -1321,15 +1646,32 @@ void VLCUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 	//
 	// Predict size for next unit for this component
 	// & store predicted size to state structure
-	dsc_state->predictedSize[cpnt] = PredictSize(dsc_cfg, required_size);;
+	dsc_state->predictedSize[cpnt] = PredictSize(required_size);;
+}
+
+
+//! Turn an underflow or overflow of any of the muxing FIFO's into a slice error
+/*! \param dsc_state DSC state structure (error is set to DSC_ERR_BUFFER)
+	\return          Nonzero if a FIFO error occurred */
+static int CheckFifoErrors(dsc_state_t *dsc_state)
+{
+	int i;
+
+	for (i=0; i<NUM_COMPONENTS; ++i)
+		if (dsc_state->shifter[i].error || dsc_state->encBalanceFifo[i].error || dsc_state->seSizeFifo[i].error)
+		{
+			printf("ERROR: Substream muxing FIFO underflow/overflow (invalid DSC stream or configuration)\n");
+			dsc_state->error = DSC_ERR_BUFFER;
+			return (1);
+		}
+	return (0);
 }
 
 
 //! Code one unit
 /*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state DSC state structure 
-	\param byte_out_p  Pointer to compressed bits buffer (modified) */
-void VLCGroup(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char **byte_out_p)
+    \param dsc_state DSC state structure */
+void VLCGroup(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state)
 {
 	int i;
 	int start_fullness[NUM_COMPONENTS];
@@ -1370,17 +1712,19 @@ void VLCGroup(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char **byte_o
 	for (i=0; i<NUM_COMPONENTS; ++i)
 		VLCUnit(dsc_cfg, dsc_state, i, dsc_state->quantizedResidual[i]);
 
-	// Keep track of fullness for each coded unit in the balance FIFO's
-	for (i=0; i<NUM_COMPONENTS; ++i)
-		fifo_put_bits(&(dsc_state->seSizeFifo[i]), dsc_state->encBalanceFifo[i].fullness - start_fullness[i], 6);
-
 	if (dsc_cfg->muxing_mode == 0)  // Write data immedately to buffer
-		WriteEntryToBitstream(dsc_cfg, dsc_state, *byte_out_p);
+		WriteEntryToBitstream(dsc_state);
 	else if (dsc_cfg->muxing_mode)  // substream muxing
 	{
+		// Keep track of fullness for each coded unit in the balance FIFO's
+		for (i=0; i<NUM_COMPONENTS; ++i)
+			fifo_put_bits(&(dsc_state->seSizeFifo[i]), dsc_state->encBalanceFifo[i].fullness - start_fullness[i], 6);
+
 		//if (dsc_state->groupCount > dsc_cfg->mux_word_size + MAX_SE_SIZE - 1)
 		if (dsc_state->groupCount > dsc_cfg->mux_word_size + MAX_SE_SIZE - 3)
-			ProcessGroupEnc(dsc_cfg, dsc_state, *byte_out_p);
+			ProcessGroupEnc(dsc_cfg, dsc_state);
+		if (CheckFifoErrors(dsc_state))
+			return;
 	}
 
 	dsc_state->bufferFullness += dsc_state->numBits - dsc_state->prevNumBits;
@@ -1389,7 +1733,8 @@ void VLCGroup(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char **byte_o
 		printf("The buffer model has overflowed.  This probably occurred due to an error in the\n");
 		printf("rate control parameter programming.\n\n");
 		printf( "ERROR: RCB overflow; size is %d, tried filling to %d\n", dsc_cfg->rcb_bits, dsc_state->bufferFullness );
-		exit(1);
+		dsc_state->error = DSC_ERR_BUFFER;
+		return;
 	}
 	dsc_state->codedGroupSize = dsc_state->numBits - dsc_state->prevNumBits;
 
@@ -1402,9 +1747,8 @@ void VLCGroup(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char **byte_o
 /*! \param dsc_cfg   DSC configuration structure
     \param dsc_state DSC state structure
 	\param cpnt      Component to code
-	\param quantized_residuals Quantized residuals
-	\param byte_in_p Pointer to compressed bits buffer (modified) */
-void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantized_residuals, unsigned char **byte_in_p)
+	\param quantized_residuals Quantized residuals */
+void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantized_residuals)
 {
 	int required_size[NUM_COMPONENTS];
 	int size;
@@ -1437,7 +1781,7 @@ void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 	{
 		if (IsFlatnessInfoSent(dsc_cfg, qp))
 		{
-			if (GetBits(dsc_cfg, dsc_state, cpnt, 1, 0, *byte_in_p))
+			if (GetBits(dsc_cfg, dsc_state, cpnt, 1, 0))
 				dsc_state->prevFirstFlat = 0;
 			else
 				dsc_state->prevFirstFlat = -1;
@@ -1451,9 +1795,9 @@ void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 	    if (dsc_state->prevFirstFlat >= 0)
 		{
 			dsc_state->flatnessType = 0;
-			if (dsc_state->masterQp >= SOMEWHAT_FLAT_QP_THRESH)
-				dsc_state->flatnessType = GetBits(dsc_cfg, dsc_state, cpnt, 1, 0, *byte_in_p);
-			dsc_state->firstFlat = GetBits(dsc_cfg, dsc_state, cpnt, 2, 0, *byte_in_p);
+			if (dsc_state->masterQp >= SOMEWHAT_FLAT_QP_THRESH(dsc_cfg->bits_per_component))
+				dsc_state->flatnessType = GetBits(dsc_cfg, dsc_state, cpnt, 1, 0);
+			dsc_state->firstFlat = GetBits(dsc_cfg, dsc_state, cpnt, 2, 0);
 			if (PRINT_DEBUG_VLC)
 				fprintf(g_fp_dbg, "First flat: %d, type: %d\n", dsc_state->firstFlat, dsc_state->flatnessType);
 		}
@@ -1464,9 +1808,7 @@ void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 		return;							// Don't read other 2 components if we're in ICH mode
 
 	max_prefix = MaxResidualSize(dsc_state, cpnt, dsc_state->masterQp) + (cpnt==0) - adj_predicted_size; // +(CType==0) for escape code
-	prefix_value = 0;
-	while ((prefix_value < max_prefix) && !GetBits(dsc_cfg, dsc_state, cpnt, 1, 0, *byte_in_p))
-		prefix_value++;
+	prefix_value = GetPrefix(dsc_cfg, dsc_state, cpnt, max_prefix);
 
 	if (PRINT_DEBUG_VLC)
 	{
@@ -1497,7 +1839,7 @@ void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 			fprintf(g_fp_dbg, "ICH mode (ecs=%d); indices: ", alt_size_to_generate);
 		for (i=0; i<PIXELS_PER_GROUP; ++i)
 		{
-			dsc_state->ichLookup[i] = GetBits(dsc_cfg, dsc_state, i, ICH_BITS, 0, *byte_in_p);
+			dsc_state->ichLookup[i] = GetBits(dsc_cfg, dsc_state, i, ICH_BITS, 0);
 			if (PRINT_DEBUG_VLC)
 				fprintf(g_fp_dbg, "%d ", dsc_state->ichLookup[i]);
 		}
@@ -1516,7 +1858,7 @@ void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 	// Get bits from input bitstream
 	max_size = 0;
 	for ( i=0; i<SAMPLES_PER_UNIT; i++ ) {
-		quantized_residuals[i] = GetBits(dsc_cfg, dsc_state, cpnt, size, 1, *byte_in_p);
+		quantized_residuals[i] = GetBits(dsc_cfg, dsc_state, cpnt, size, 1);
 		if (PRINT_DEBUG_VLC)
 			fprintf(g_fp_dbg, "Sample delta %d = %d\n", i, quantized_residuals[i]);
 		required_size[i] = FindResidualSize( quantized_residuals[i] );
@@ -1536,26 +1878,27 @@ void VLDUnit(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int cpnt, int *quantize
 	//
 	// Predict size for next unit for this component
 	// and store predicted size to state structure
-	dsc_state->predictedSize[cpnt] = PredictSize(dsc_cfg, required_size);
+	dsc_state->predictedSize[cpnt] = PredictSize(required_size);
 }
 
 
 //! Decode one group
 /*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state DSC state structure
-	\param byte_in_p Pointer to compressed data buffer (modified) */
-void VLDGroup(dsc_cfg_t* dsc_cfg, dsc_state_t* dsc_state, unsigned char** byte_in_p)
+    \param dsc_state DSC state structure */
+void VLDGroup(dsc_cfg_t* dsc_cfg, dsc_state_t* dsc_state)
 {
 	int prevNumBits = dsc_state->numBits;
 	int i;
 
 	if (dsc_cfg->muxing_mode)
-		ProcessGroupDec(dsc_cfg, dsc_state, *byte_in_p);
+		ProcessGroupDec(dsc_cfg, dsc_state);
 
 	// *MODEL NOTE* MN_DEC_ENTROPY
 	// 444; Unit is same as CType
 	for (i=0; i<NUM_COMPONENTS; ++i)
-		VLDUnit(dsc_cfg, dsc_state, i, dsc_state->quantizedResidual[i], byte_in_p);
+		VLDUnit(dsc_cfg, dsc_state, i, dsc_state->quantizedResidual[i]);
+	if (dsc_cfg->muxing_mode && CheckFifoErrors(dsc_state))
+		return;
 
 	dsc_state->prevMasterQp = dsc_state->masterQp;
 	dsc_state->codedGroupSize = dsc_state->numBits - prevNumBits;
@@ -1565,7 +1908,8 @@ void VLDGroup(dsc_cfg_t* dsc_cfg, dsc_state_t* dsc_state, unsigned char** byte_i
 		// This check may actually belong after tgt_bpg has been subtracted
 		printf("The buffer model has overflowed.  This probably occurred due to an attempt to decode an invalid DSC stream.\n\n");
 		printf( "ERROR: RCB overflow; size is %d, tried filling to %d\n", dsc_cfg->rcb_bits, dsc_state->bufferFullness );
-		exit(1);
+		dsc_state->error = DSC_ERR_BUFFER;
+		return;
 	}
 	
 	if ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP) == dsc_state->firstFlat)
@@ -1597,15 +1941,115 @@ int SampToLineBuf( dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int x, int cpnt)
 }
 
 
-//! Initialize the DSC state
+//! Reduce a run of samples to line buffer precision in place (same as SampToLineBuf on each sample)
 /*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state DSC state structure 
+    \param dsc_state DSC state structure
+	\param line      Samples (modified)
+	\param n         Number of samples
+	\param cpnt      Component to process */
+static void ReduceLine( dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int *line, int n, int cpnt)
+{
+	int i;
+	int shift_amount = MAX(dsc_state->cpntBitDepth[cpnt] - dsc_cfg->linebuf_depth, 0);
+	int round = (shift_amount > 0) ? (1<<(shift_amount-1)) : 0;
+	int maxval = (1<<dsc_cfg->linebuf_depth) - 1;
+
+	if (shift_amount == 0)
+		return;    // Samples already fit in the line buffer
+	for (i=0; i<n; ++i)
+		line[i] = MIN((line[i]+round)>>shift_amount, maxval) << shift_amount;
+}
+
+
+//! Allocate the line buffers and FIFO's used by the DSC state
+/*! The buffers are sized for dsc_cfg's slice width, mux word size and bit depth, and
+    can be reused for any number of slices coded with the same values.
+	\param dsc_cfg   DSC configuration structure
+    \param dsc_state DSC state structure (modified)
+	\return          DSC_OK or DSC_ERR_NOMEM */
+int AllocDSCState( dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state )
+{
+	int i;
+	int lbufWidth = dsc_cfg->slice_width + PADDING_LEFT + PADDING_RIGHT;
+	int nblocks = (dsc_cfg->slice_width+PRED_BLK_SIZE-1) / PRED_BLK_SIZE;
+	int ok;
+
+	memset(dsc_state, 0, sizeof(dsc_state_t));
+
+	dsc_state->prevLinePred = (PRED_TYPE *)malloc(sizeof(PRED_TYPE) * nblocks);
+	ok = (dsc_state->prevLinePred != NULL);
+	for (i=0; i<NUM_COMPONENTS; ++i)
+	{
+		dsc_state->currLine[i] = (int *)malloc(lbufWidth*sizeof(int));
+		dsc_state->prevLine[i] = (int *)malloc(lbufWidth*sizeof(int));
+		dsc_state->origLine[i] = (int *)malloc(lbufWidth*sizeof(int));
+		dsc_state->outLine[i] = (int *)malloc(dsc_cfg->slice_width*sizeof(int));
+		dsc_state->bpLine[i] = (short *)malloc(sizeof(short) * (BP_LINE_PAD + dsc_cfg->slice_width));
+		dsc_state->bpBlockSad[i] = (short *)malloc(sizeof(short) * BP_RANGE * nblocks);
+		fifo_init(&(dsc_state->shifter[i]), (dsc_cfg->mux_word_size + MAX_SE_SIZE + 7) / 8);
+		fifo_init(&(dsc_state->encBalanceFifo[i]), ((dsc_cfg->mux_word_size + MAX_SE_SIZE - 1) * (MAX_SE_SIZE) + 7)/8);
+		fifo_init(&(dsc_state->seSizeFifo[i]), (6 * (dsc_cfg->mux_word_size + MAX_SE_SIZE - 1) + 7)/8 );
+		ok = ok && dsc_state->currLine[i] && dsc_state->prevLine[i] && dsc_state->origLine[i] && dsc_state->outLine[i] &&
+			dsc_state->bpLine[i] && dsc_state->bpBlockSad[i] && dsc_state->shifter[i].data &&
+			dsc_state->encBalanceFifo[i].data && dsc_state->seSizeFifo[i].data;
+	}
+
+	if (!ok)
+	{
+		FreeDSCState(dsc_state);
+		return (DSC_ERR_NOMEM);
+	}
+	return (DSC_OK);
+}
+
+
+//! Free the buffers allocated by AllocDSCState
+/*! \param dsc_state DSC state structure */
+void FreeDSCState( dsc_state_t *dsc_state )
+{
+	int i;
+
+	for (i=0; i<NUM_COMPONENTS; ++i)
+	{
+		free(dsc_state->currLine[i]);
+		free(dsc_state->prevLine[i]);
+		free(dsc_state->origLine[i]);
+		free(dsc_state->outLine[i]);
+		free(dsc_state->bpLine[i]);
+		free(dsc_state->bpBlockSad[i]);
+		fifo_free(&(dsc_state->shifter[i]));
+		fifo_free(&(dsc_state->encBalanceFifo[i]));
+		fifo_free(&(dsc_state->seSizeFifo[i]));
+	}
+	free(dsc_state->prevLinePred);
+	memset(dsc_state, 0, sizeof(dsc_state_t));
+}
+
+
+//! Initialize the DSC state for a new slice
+/*! \param dsc_cfg   DSC configuration structure
+    \param dsc_state DSC state structure (buffers must have been allocated with AllocDSCState)
 	\return          Returns dsc_state that was passed in */
 dsc_state_t *InitializeDSCState( dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state )
 {
 	int i, j, k;
+	dsc_state_t buffers = *dsc_state;
 
+	// Clear everything but the buffers from AllocDSCState
 	memset(dsc_state, 0, sizeof(dsc_state_t));
+	dsc_state->prevLinePred = buffers.prevLinePred;
+	for (i=0; i<NUM_COMPONENTS; ++i)
+	{
+		dsc_state->currLine[i] = buffers.currLine[i];
+		dsc_state->prevLine[i] = buffers.prevLine[i];
+		dsc_state->origLine[i] = buffers.origLine[i];
+		dsc_state->outLine[i] = buffers.outLine[i];
+		dsc_state->bpLine[i] = buffers.bpLine[i];
+		dsc_state->bpBlockSad[i] = buffers.bpBlockSad[i];
+		dsc_state->shifter[i] = buffers.shifter[i];
+		dsc_state->encBalanceFifo[i] = buffers.encBalanceFifo[i];
+		dsc_state->seSizeFifo[i] = buffers.seSizeFifo[i];
+	}
 
 	// Initialize quantization table
 	if (dsc_cfg->bits_per_component == 12)
@@ -1653,26 +2097,19 @@ dsc_state_t *InitializeDSCState( dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state )
 		}
 	}
 
-	dsc_state->prevLinePred = (PRED_TYPE *)malloc(sizeof(PRED_TYPE) * (dsc_cfg->slice_width+PRED_BLK_SIZE-1) / PRED_BLK_SIZE);
-	assert(dsc_state->prevLinePred != NULL);
 	// Sets last predictor of line to MAP, since BP search is not done for partial groups
-	memset(dsc_state->prevLinePred, 0, sizeof(PRED_TYPE) * (dsc_cfg->slice_width+PRED_BLK_SIZE-1) / PRED_BLK_SIZE);  
-	
-	dsc_state->history.valid = (int *)malloc(sizeof(int)*ICH_SIZE);
-	assert(dsc_state->history.valid != NULL);
-	for(i=0; i<ICH_SIZE; ++i)
-		dsc_state->history.valid[i] = 0;
-	for(i=0; i<NUM_COMPONENTS; ++i)
-	{
-		dsc_state->history.pixels[i] = (unsigned int*)malloc(sizeof(unsigned int)*ICH_SIZE);
-	}
+	memset(dsc_state->prevLinePred, 0, sizeof(PRED_TYPE) * ((dsc_cfg->slice_width+PRED_BLK_SIZE-1) / PRED_BLK_SIZE));
+
+	dsc_state->history.valid = 0;
 	dsc_state->ichSelected = 0;
 
 	for(i=0; i<NUM_COMPONENTS; ++i)
 	{
-		fifo_init(&(dsc_state->shifter[i]), (dsc_cfg->mux_word_size + MAX_SE_SIZE + 7) / 8);
-		fifo_init(&(dsc_state->encBalanceFifo[i]), ((dsc_cfg->mux_word_size + MAX_SE_SIZE - 1) * (MAX_SE_SIZE) + 7)/8);
-		fifo_init(&(dsc_state->seSizeFifo[i]), (6 * (dsc_cfg->mux_word_size + MAX_SE_SIZE - 1) + 7)/8 );
+		fifo_reset(&(dsc_state->shifter[i]));
+		fifo_reset(&(dsc_state->encBalanceFifo[i]));
+		fifo_reset(&(dsc_state->seSizeFifo[i]));
+		dsc_state->seData[i] = 0;
+		dsc_state->seBits[i] = 0;
 	}
 
 	return dsc_state;
@@ -1779,46 +2216,190 @@ void CalcFullnessOffset(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int vPos, in
 	\param vPos      Which line of slice to use */
 void PopulateOrigLine(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, pic_t *ip, int vPos)
 {
-	int i, cpnt, w, pic_w;
-
+	int i, cpnt, n, w;
+	int row = dsc_cfg->ystart + vPos;
+	int *dst;
+
+	w = dsc_cfg->slice_width;
+	// Right padding replicates the last pixel of the slice so that no pixels
+	// belonging to the neighboring slice are read (they are never used).
+	n = MIN(ip->w, dsc_cfg->xstart + w) - dsc_cfg->xstart;
 	for (cpnt = 0; cpnt < NUM_COMPONENTS; ++cpnt)
 	{
-		w = dsc_cfg->slice_width;
-		pic_w = ip->w;
-		for (i=0; i<w+PADDING_RIGHT; ++i)
+		dst = dsc_state->origLine[cpnt] + PADDING_LEFT;
+		if (row >= ip->h)
 		{
 			// Padding for lines that fall off the bottom of the raster uses midpoint value
-			if(dsc_cfg->ystart+vPos >= ip->h)
-				dsc_state->origLine[cpnt][i+PADDING_LEFT] = 1<<(dsc_state->cpntBitDepth[cpnt]-1);
-			else switch (cpnt)
+			for (i=0; i<w+PADDING_RIGHT; ++i)
+				dst[i] = 1<<(dsc_state->cpntBitDepth[cpnt]-1);
+			continue;
+		}
+		if (ip->sample_bytes == sizeof(int))
+			memcpy(dst, (cpnt==0 ? ip->data.yuv.y : cpnt==1 ? ip->data.yuv.u : ip->data.yuv.v)[row] + dsc_cfg->xstart, n * sizeof(int));
+		else
+		{
+			const unsigned short *src = PIC_ROW16(ip, cpnt, row) + dsc_cfg->xstart;
+			for (i=0; i<n; ++i)
+				dst[i] = src[i];
+		}
+		for (i=n; i<w+PADDING_RIGHT; ++i)
+			dst[i] = dst[n-1];
+	}
+
+	// RGB input is converted to YCoCg as each line is read (midpoint padding is already YCoCg)
+	if (dsc_cfg->convert_rgb && (dsc_cfg->ystart+vPos < ip->h))
+		rgb2ycocg_line(dsc_state->origLine[0]+PADDING_LEFT, dsc_state->origLine[1]+PADDING_LEFT, dsc_state->origLine[2]+PADDING_LEFT,
+			dsc_cfg->slice_width+PADDING_RIGHT, ip->bits);
+}
+
+
+//! Write a line of samples to a packed output buffer
+/*! \param out       Packed output buffer description
+	\param line      Samples for each component
+	\param n         Number of samples
+	\param bits      Bits per sample
+	\param row       Picture row
+	\param x0        Picture column of the first sample */
+static void PackLine(const dsc_packed_out_t *out, int **line, int n, int bits, int row, int x0)
+{
+	int i, cpnt;
+	int shift8 = bits - 8;
+
+	switch (out->format)
+	{
+	case PACK_RGB8:
+		{
+			unsigned char *d = out->buf + (size_t)row * out->stride + x0 * NUM_COMPONENTS;
+			for (i=0; i<n; ++i, d+=NUM_COMPONENTS)
 			{
-			case 0:
-				dsc_state->origLine[cpnt][i+PADDING_LEFT] = ip->data.yuv.y[MIN(dsc_cfg->ystart+vPos, ip->h-1)][MIN(dsc_cfg->xstart+i, ip->w-1)];
-				break;
-			case 1:
-				dsc_state->origLine[cpnt][i+PADDING_LEFT] = ip->data.yuv.u[MIN(dsc_cfg->ystart+vPos, ip->h-1)][MIN(dsc_cfg->xstart+i, pic_w-1)];
-				break;
-			case 2:
-				dsc_state->origLine[cpnt][i+PADDING_LEFT] = ip->data.yuv.v[MIN(dsc_cfg->ystart+vPos, ip->h-1)][MIN(dsc_cfg->xstart+i, pic_w-1)];
-				break;
+				d[0] = (unsigned char)(line[0][i] >> shift8);
+				d[1] = (unsigned char)(line[1][i] >> shift8);
+				d[2] = (unsigned char)(line[2][i] >> shift8);
 			}
 		}
+		break;
+	case PACK_RGB16:
+		{
+			unsigned short *d = (unsigned short *)(out->buf + (size_t)row * out->stride) + x0 * NUM_COMPONENTS;
+			for (i=0; i<n; ++i, d+=NUM_COMPONENTS)
+			{
+				d[0] = (unsigned short)line[0][i];
+				d[1] = (unsigned short)line[1][i];
+				d[2] = (unsigned short)line[2][i];
+			}
+		}
+		break;
+	case PACK_PLANAR8:
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			unsigned char *d = out->buf + (size_t)cpnt * out->plane_stride + (size_t)row * out->stride + x0;
+			for (i=0; i<n; ++i)
+				d[i] = (unsigned char)(line[cpnt][i] >> shift8);
+		}
+		break;
+	case PACK_PLANAR16:
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			unsigned short *d = (unsigned short *)(out->buf + (size_t)cpnt * out->plane_stride + (size_t)row * out->stride) + x0;
+			for (i=0; i<n; ++i)
+				d[i] = (unsigned short)line[cpnt][i];
+		}
+		break;
+	}
+}
+
+
+//! Write a finished line of reconstructed samples to the output picture (or packed buffer)
+/*! Each line is written exactly once, after any midpoint or ICH substitutions.
+    \param dsc_cfg   DSC configuration structure
+    \param dsc_state DSC state structure 
+	\param op        Output picture (ignored if packed_out is set)
+	\param packed_out Packed output buffer (or NULL)
+	\param vPos      Vertical position within slice */
+static void CommitLine(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, pic_t *op, const dsc_packed_out_t *packed_out, int vPos)
+{
+	int row = dsc_cfg->ystart + vPos;
+	int x0 = dsc_cfg->xstart;
+	int pic_w = packed_out ? dsc_cfg->pic_width : op->w;
+	int pic_h = packed_out ? dsc_cfg->pic_height : op->h;
+	int *src[NUM_COMPONENTS];
+	int n, cpnt;
+
+	for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		src[cpnt] = dsc_state->currLine[cpnt] + PADDING_LEFT;
+
+	if (PRINT_DEBUG_RECON)
+	{
+		int i;
+		for (i=0; i<dsc_cfg->slice_width; ++i)
+			fprintf(g_fp_dbg, "\n%d, %d: %d %d %d ", i, vPos, src[0][i], src[1][i], src[2][i]);
+	}
+#ifdef PRINTDEBUG
+	fflush(g_fp_dbg);
+#endif
+
+	if (row >= pic_h)
+		return;
+	n = MIN(dsc_cfg->slice_width, pic_w - x0);
+
+	if (packed_out)
+	{
+		if (dsc_cfg->convert_rgb)
+		{
+			ycocg2rgb_line(src[0], src[1], src[2], n, dsc_cfg->bits_per_component, dsc_state->outLine[0], dsc_state->outLine[1], dsc_state->outLine[2]);
+			PackLine(packed_out, dsc_state->outLine, n, dsc_cfg->bits_per_component, row, x0);
+		}
+		else
+			PackLine(packed_out, src, n, dsc_cfg->bits_per_component, row, x0);
+	}
+	else if (op->sample_bytes != sizeof(int))
+	{
+		int **line = src;
+		int i;
+
+		if (dsc_cfg->convert_rgb)
+		{
+			ycocg2rgb_line(src[0], src[1], src[2], n, dsc_cfg->bits_per_component, dsc_state->outLine[0], dsc_state->outLine[1], dsc_state->outLine[2]);
+			line = dsc_state->outLine;
+		}
+		for (cpnt=0; cpnt<NUM_COMPONENTS; ++cpnt)
+		{
+			unsigned short *d = PIC_ROW16(op, cpnt, row) + x0;
+			for (i=0; i<n; ++i)
+				d[i] = (unsigned short)line[cpnt][i];
+		}
+	}
+	else if (dsc_cfg->convert_rgb)
+	{
+		// Convert back to RGB directly into the output picture
+		ycocg2rgb_line(src[0], src[1], src[2], n, dsc_cfg->bits_per_component, op->data.rgb.r[row]+x0, op->data.rgb.g[row]+x0, op->data.rgb.b[row]+x0);
+	}
+	else
+	{
+		memcpy(op->data.yuv.y[row]+x0, src[0], n*sizeof(int));
+		memcpy(op->data.yuv.u[row]+x0, src[1], n*sizeof(int));
+		memcpy(op->data.yuv.v[row]+x0, src[2], n*sizeof(int));
 	}
 }
 
 
 //! Main DSC encoding and decoding algorithm
-/*! \param isEncoder Flag indicating whether to do an encode (1) or decode (0)
+/*! The slice kernel is instantiated for each combination of isEncoder, bpc and convert_rgb (see
+    DSC_CodeSlice()), so that these are compile-time constants in the inner loops.
+	\param isEncoder Flag indicating whether to do an encode (1) or decode (0)
+	\param bpc       Bits per component (same as dsc_cfg->bits_per_component)
+	\param convert_rgb Flag indicating RGB input/output with YCoCg coding (same as dsc_cfg->convert_rgb)
     \param dsc_cfg   DSC configuration structure
+	\param dsc_state DSC state structure (buffers must have been allocated with AllocDSCState)
 	\param ip        Input picutre
-	\param op        Output picture (modified, only affects area of current slice)
+	\param op        Output picture (modified, only affects area of current slice; may be NULL if packed_out is used)
+	\param packed_out Packed buffer to write the reconstructed samples to instead of op (or NULL)
 	\param cmpr_buf  Compressed data buffer (modified for encoder)
-	\param temp_pic  Array of two temporary pictures to use for RGB-YCoCg conversion and back 
-	\param chunk_sizes Array to hold sizes in bytes for each slice multiplexed chunk (modified for encoder) */
-int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsigned char* cmpr_buf, pic_t **temp_pic, int *chunk_sizes)
+	\param chunk_sizes Array to hold sizes in bytes for each slice multiplexed chunk (modified for encoder)
+	\return          DSC_OK, or a DSC_ERROR code (the number of bits coded is left in dsc_state->postMuxNumBits) */
+static DSC_FORCEINLINE int CodeSliceKernel(int isEncoder, int bpc, int convert_rgb, dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, pic_t* ip, pic_t* op, const dsc_packed_out_t *packed_out, unsigned char* cmpr_buf, int *chunk_sizes)
 {
-	dsc_state_t dsc_state_storage, *dsc_state;
-	pic_t* pic, *orig_op, *opic;
+	pic_t* pic;
 	int i;
 	int vPos;
 	int hPos;
@@ -1827,22 +2408,21 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 	int sampModCnt;
 	int cpnt;
 	int pred_x;
-	int actual_x = 0;
-	int recon_x;
-	int err_raw;
 	int err_q;
 	int *currLine[NUM_COMPONENTS];
 	int *prevLine[NUM_COMPONENTS];
+	int initValue[NUM_COMPONENTS];
 	int lbufWidth;
 	int range[NUM_COMPONENTS];
-	int maxval;
 	int qp;
-	int qlevel;
 	int group_count = 0;
 	int throttle_offset, bpg_offset;
 	int scale;
 	int new_quant;
 	PRED_TYPE pred2use;
+	// Quantization tables for the bit depth (same as dsc_state->quantTableLuma/Chroma)
+	const int *qlevel_luma = (bpc == 12) ? qlevel_luma_12bpc : (bpc == 10) ? qlevel_luma_10bpc : qlevel_luma_8bpc;
+	const int *qlevel_chroma = (bpc == 12) ? qlevel_chroma_12bpc : (bpc == 10) ? qlevel_chroma_10bpc : qlevel_chroma_8bpc;
 
 #ifdef PRINTDEBUG
 	if(isEncoder)
@@ -1851,20 +2431,24 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 		g_fp_dbg = fopen("log_decode.txt","wt");
 #endif
 
-	dsc_state = InitializeDSCState( dsc_cfg, &dsc_state_storage );
+	InitializeDSCState( dsc_cfg, dsc_state );
 	dsc_state->isEncoder = isEncoder;
 	dsc_state->chunkSizes = chunk_sizes;
+	if (isEncoder)
+		bitwriter_init(&dsc_state->bitWriter, cmpr_buf);
+	else
+		bitreader_init(&dsc_state->bitReader, cmpr_buf, dsc_cfg->chunk_size * dsc_cfg->slice_height);
 
-	orig_op = op;
-	if ( dsc_cfg->convert_rgb ) {
-		// convert rgb to ycocg
-		pic = temp_pic[0];
-		opic = temp_pic[1];
-		op = opic;
-		rgb2ycocg(ip, pic, dsc_cfg);
-	} else {
-		// no color conversion
-		pic = ip;
+	// With convert_rgb, RGB-YCoCg conversion is done a line at a time on input and output
+	pic = ip;
+	if ( convert_rgb && ((isEncoder && ((ip->color != RGB) || (ip->chroma != YUV_444))) ||
+		(!packed_out && ((op->color != RGB) || (op->chroma != YUV_444)))) )
+	{
+		printf("ERROR: Expect RGB 4:4:4 pictures when convert_rgb is enabled\n");
+#ifdef PRINTDEBUG
+		fclose(g_fp_dbg);
+#endif
+		return (DSC_ERR_CONFIG);
 	}
 
 	// line buffers have padding to left and right
@@ -1873,41 +2457,42 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 	// initialize DSC variables
 	for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ )
 	{
-		int initValue;
-		if ( dsc_cfg->convert_rgb ) 
+		if ( convert_rgb ) 
 		{
-			initValue = 1 << (pic->bits - 1);
+			initValue[cpnt] = 1 << (bpc - 1);
 			if(cpnt != 0)
-				initValue *= 2;
+				initValue[cpnt] *= 2;
 		}
 		else
-			initValue = 1 << (pic->bits-1);
+			initValue[cpnt] = 1 << (bpc-1);
 
-		dsc_state->currLine[cpnt] = currLine[cpnt] = (int*) malloc(lbufWidth*sizeof(int));
-		dsc_state->prevLine[cpnt] = prevLine[cpnt] = (int*) malloc(lbufWidth*sizeof(int));
-		dsc_state->origLine[cpnt] = (int*) malloc(lbufWidth*sizeof(int));
+		currLine[cpnt] = dsc_state->currLine[cpnt];
+		prevLine[cpnt] = dsc_state->prevLine[cpnt];
 		for ( i=0; i<lbufWidth; i++ ) {
-			currLine[cpnt][i] = initValue;
-			prevLine[cpnt][i] = initValue;
+			currLine[cpnt][i] = initValue[cpnt];
+			prevLine[cpnt][i] = initValue[cpnt];
 		}
 	}
 
 	//--------------------------------------------------------------------------
 	// sample range handling
 	//
-	if ( pic->bits != dsc_cfg->bits_per_component )
+	if ( (pic != NULL) && (pic->bits != bpc) )
 	{
 		printf("ERROR: Expect picture bit depth to match configuration\n");
-		exit(1);
+#ifdef PRINTDEBUG
+		fclose(g_fp_dbg);
+#endif
+		return (DSC_ERR_CONFIG);
 	}
 
 	for ( i=0; i<NUM_COMPONENTS; i++ )
 	{
-		range[i] = 1<<dsc_cfg->bits_per_component;
-		dsc_state->cpntBitDepth[i] = dsc_cfg->bits_per_component;
+		range[i] = 1<<bpc;
+		dsc_state->cpntBitDepth[i] = bpc;
 	}
 
-	if (dsc_cfg->convert_rgb)
+	if (convert_rgb)
 	{
 		range[1] *= 2;
 		range[2] *= 2;
@@ -1918,7 +2503,7 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 	dsc_state->groupCountLine = 0;
 	// If decoder, read first group's worth of data
 	if ( !isEncoder )
-		VLDGroup( dsc_cfg, dsc_state, &cmpr_buf );
+		VLDGroup( dsc_cfg, dsc_state );
 
 	vPos = 0;
 	hPos = 0;
@@ -1933,346 +2518,287 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 		PopulateOrigLine(dsc_cfg, dsc_state, pic, 0);
 
 
-	while ( !done ) {
+	while ( !done && !dsc_state->error ) {
+		int npix = MIN(PIXELS_PER_GROUP, dsc_cfg->slice_width - hPos);  // Real pixels in the group (fewer at the end of a line)
+		int hLast = hPos + PIXELS_PER_GROUP - 1;   // Last position of the (padded) group
+		int pred[PRED_LANES];
+		int recon[PRED_LANES];
+		group_pred_t gp;
+		group_quant_t gq;
+		int max_size;
+
 		dsc_state->vPos = vPos;
-		if ((hPos % PIXELS_PER_GROUP)==0)
+		// Note that UpdateICHistory works on the group to the left
+		for (i=0; i<PIXELS_PER_GROUP; ++i)
+			UpdateICHistory(dsc_cfg, dsc_state, currLine, hPos+i, vPos);
+
+		// QP, predictor and prediction neighborhood are fixed for the whole group
+		if (isEncoder)
+			dsc_state->masterQp = qp;
+		if (vPos==0)
+		{
+			// Use left predictor.  Modified MAP doesn't make sense since there is no previous line.
+			pred2use = PT_LEFT;
+		}
+		else
+		{
+			pred2use = dsc_state->prevLinePred[hPos/PRED_BLK_SIZE];
+		}
+		for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ ) {
+			gq.qlevel[cpnt] = (cpnt == 0) ? qlevel_luma[qp] : qlevel_chroma[qp];
+			gq.midpoint[cpnt] = FindMidpoint(dsc_state, cpnt, gq.qlevel[cpnt]);
+			max_size = MaxResidualSize(dsc_state, cpnt, qp);
+			gq.midMin[cpnt] = (max_size > 0) ? -(1 << (max_size-1)) : 0;
+			gq.midMax[cpnt] = (max_size > 0) ? (1 << (max_size-1)) - 1 : 0;
+			gq.maxval[cpnt] = range[cpnt] - 1;
+		}
+		gq.qlevel[NUM_COMPONENTS] = gq.midpoint[NUM_COMPONENTS] = gq.maxval[NUM_COMPONENTS] = 0;
+		gq.midMin[NUM_COMPONENTS] = gq.midMax[NUM_COMPONENTS] = 0;
+		GroupPredictSetup( dsc_state, prevLine, currLine, hPos, pred2use, gq.qlevel, &gp );
+		if (isEncoder)
 		{
-			// Note that UpdateICHistory works on the group to the left
 			for (i=0; i<PIXELS_PER_GROUP; ++i)
-				UpdateICHistory(dsc_cfg, dsc_state, currLine, sampModCnt, hPos+i, vPos);
+				dsc_state->origWithinQerr[i] = 1;
 		}
 
-		for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ ) {
-			qlevel = MapQpToQlevel(dsc_state, qp, cpnt);
+		for ( sampModCnt = 0; sampModCnt < npix; sampModCnt++ ) {
+			int x = hPos + sampModCnt;
 
-			if (vPos==0)
-			{
-				// Use left predictor.  Modified MAP doesn't make sense since there is no previous line.
-				pred2use = PT_LEFT;
-			}
-			else
-			{
-				pred2use = dsc_state->prevLinePred[hPos/PRED_BLK_SIZE];
+			if (!isEncoder && dsc_state->ichSelected) {  // IC$ selected on decoder - do an ICH look-up
+				unsigned int p[NUM_COMPONENTS];
+				HistoryLookup(dsc_cfg, dsc_state, dsc_state->ichLookup[sampModCnt], p, x, (vPos==0));
+				for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ )
+					currLine[cpnt][x+hSkew] = p[cpnt];
+				continue;
 			}
-			pred_x = SamplePredict( dsc_state, prevLine[cpnt], currLine[cpnt], hPos, 
-									pred2use, qlevel, cpnt);
 
-			// Compute residual and quantize:
+			GroupPredict( dsc_state, &gp, currLine, x, pred );
 			if ( isEncoder ) {
-				//
-				// find residual and quantize it
-				//
-				actual_x = dsc_state->origLine[cpnt][hPos+PADDING_LEFT];
-				err_raw = actual_x - pred_x;
-
-				if (sampModCnt==0)
-					dsc_state->masterQp = qp;
-
-				qlevel = MapQpToQlevel(dsc_state, qp, cpnt);
-
-				err_q = QuantizeResidual( err_raw, qlevel);
-					
-				err_raw = actual_x - FindMidpoint(dsc_state, cpnt, qlevel);
-
-				// Calculate midpoint prediction error:
-				dsc_state->quantizedResidualMid[cpnt][sampModCnt] = QuantizeResidual(err_raw, qlevel);
-					
-				// Midpoint residuals need to be bounded to BPC-QP in size, this is for some corner cases:
-				if (dsc_state->quantizedResidualMid[cpnt][sampModCnt] > 0)
-					while (FindResidualSize(dsc_state->quantizedResidualMid[cpnt][sampModCnt]) > MaxResidualSize(dsc_state, cpnt, qp))
-						dsc_state->quantizedResidualMid[cpnt][sampModCnt]--;
-				else
-					while (FindResidualSize(dsc_state->quantizedResidualMid[cpnt][sampModCnt]) > MaxResidualSize(dsc_state, cpnt, qp))
-						dsc_state->quantizedResidualMid[cpnt][sampModCnt]++;
-							
-				// store to array
-				dsc_state->quantizedResidual[cpnt][sampModCnt] = err_q;
+				// Compute residuals, quantize and reconstruct
+				QuantizePixel( bpc, dsc_state, &gq, x, sampModCnt, pred, recon );
 			}
 			else  // DECODER:
 			{
-				// Decoder takes error from bitstream
-				err_q = dsc_state->quantizedResidual[cpnt][sampModCnt];
+				for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ ) {
+					// Decoder takes error from bitstream
+					err_q = dsc_state->quantizedResidual[cpnt][sampModCnt];
 
-				qlevel = MapQpToQlevel(dsc_state, qp, cpnt);
+					// Use midpoint prediction if selected
+					pred_x = dsc_state->useMidpoint[cpnt] ? gq.midpoint[cpnt] : pred[cpnt];
 
-				// Use midpoint prediction if selected
-				if (dsc_state->useMidpoint[cpnt])
-					pred_x = FindMidpoint(dsc_state, cpnt, qlevel);
+					// *MODEL NOTE* MN_IQ_RECON
+					recon[cpnt] = CLAMP(pred_x + (err_q << gq.qlevel[cpnt]), 0, gq.maxval[cpnt]);
+				}
 			}
 
-			//-----------------------------------------------------------------
-			// reconstruct
-			// *MODEL NOTE* MN_IQ_RECON
-			maxval = range[cpnt] - 1;
-			recon_x = CLAMP(pred_x + (err_q << qlevel), 0, maxval);
-			if (isEncoder)
-			{
-				int absErr;
+			// Save reconstructed value in line store
+			for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ )
+				currLine[cpnt][x+hSkew] = recon[cpnt];
 
-				absErr = abs(actual_x - recon_x) >> (dsc_cfg->bits_per_component - 8);
-				if ((sampModCnt==0))
-					dsc_state->maxError[cpnt] = absErr;
-				else
-					dsc_state->maxError[cpnt] = MAX(dsc_state->maxError[cpnt], absErr);
-			}
-			if (isEncoder)
+			if (isEncoder && IsOrigWithinQerr(dsc_cfg, dsc_state, x, vPos, dsc_state->masterQp, sampModCnt, &dsc_state->ichLookup[sampModCnt]))
 			{
-				int midpoint_pred, midpoint_recon, absErr;
-
-				// Encoder always computes midpoint value in case any residual size >= BPC - QP
-				midpoint_pred = FindMidpoint(dsc_state, cpnt, qlevel);
-				midpoint_recon = midpoint_pred + (dsc_state->quantizedResidualMid[cpnt][sampModCnt] << qlevel);
-				dsc_state->midpointRecon[cpnt][sampModCnt] = CLAMP(midpoint_recon, 0, maxval);
-				absErr = abs(actual_x - dsc_state->midpointRecon[cpnt][sampModCnt]) >> (dsc_cfg->bits_per_component - 8);
-				if ((sampModCnt==0))
-					dsc_state->maxMidError[cpnt] = absErr;
-				else
-					dsc_state->maxMidError[cpnt] = MAX(dsc_state->maxMidError[cpnt], absErr);
-			}
-				
-			if (!isEncoder && dsc_state->ichSelected) {  // IC$ selected on decoder - do an ICH look-up
-				unsigned int p[NUM_COMPONENTS];
-				HistoryLookup(dsc_cfg, dsc_state, dsc_state->ichLookup[sampModCnt], p, hPos, (vPos==0));
-				recon_x = p[cpnt];
-			}
+				unsigned int orig[NUM_COMPONENTS];
 
-			// Save reconstructed value in line store
-			currLine[cpnt][hPos+hSkew] = recon_x;
-
-			// Copy reconstructed samples to output picture structure
-			if ((vPos+dsc_cfg->ystart < op->h) && (hPos+dsc_cfg->xstart < op->w)) {
-				switch ( cpnt ) {
-				case  0: op->data.yuv.y[vPos+dsc_cfg->ystart][hPos+dsc_cfg->xstart] = recon_x; break;
-				case  1: op->data.yuv.u[vPos+dsc_cfg->ystart][hPos+dsc_cfg->xstart] = recon_x; break;
-				case  2: op->data.yuv.v[vPos+dsc_cfg->ystart][hPos+dsc_cfg->xstart] = recon_x; break;
+				// Have to remember pixel values for the selected entry
+				for (cpnt=0; cpnt < NUM_COMPONENTS; ++cpnt)
+				{
+					int absErr;
+
+					orig[cpnt] = dsc_state->origLine[cpnt][PADDING_LEFT+x];
+					dsc_state->ichPixels[sampModCnt][cpnt] = dsc_state->ichSnapPixels[cpnt][dsc_state->ichLookup[sampModCnt]];
+					absErr = abs((int)dsc_state->ichPixels[sampModCnt][cpnt] - (int)orig[cpnt]) >> (bpc - 8);
+					if (sampModCnt==0) dsc_state->maxIchError[cpnt] = 0;
+					dsc_state->maxIchError[cpnt] = MAX(dsc_state->maxIchError[cpnt], absErr);
 				}
 			}
 		}
 
 		// Update QP per group
-		if ((sampModCnt==PIXELS_PER_GROUP-1) || (hPos==dsc_cfg->slice_width-1))
-		{
-			if ( isEncoder ) {
-				// *MODEL NOTE* MN_ENC_FLATNESS_DECISION
-				if (IsFlatnessInfoSent(dsc_cfg, qp) && ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP) == 3))
-				{
-					if (dsc_state->firstFlat >= 0)
-						dsc_state->prevIsFlat = 1;
-					else
-						dsc_state->prevIsFlat = 0;
-					dsc_state->prevFirstFlat = -1;
+		if ( isEncoder ) {
+			// *MODEL NOTE* MN_ENC_FLATNESS_DECISION
+			if (IsFlatnessInfoSent(dsc_cfg, qp) && ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP) == 3))
+			{
+				if (dsc_state->firstFlat >= 0)
+					dsc_state->prevIsFlat = 1;
+				else
+					dsc_state->prevIsFlat = 0;
+				dsc_state->prevFirstFlat = -1;
 
-					for (i=0; i<GROUPS_PER_SUPERGROUP; ++i)
+				for (i=0; i<GROUPS_PER_SUPERGROUP; ++i)
+				{
+					int flatness_type;
+					
+					flatness_type = IsOrigFlatHIndex(dsc_cfg, dsc_state, hPos + npix - 1 + (i+1)*PIXELS_PER_GROUP);
+					if (!dsc_state->prevIsFlat && flatness_type)
 					{
-						int flatness_type;
-						
-						flatness_type = IsOrigFlatHIndex(dsc_cfg, dsc_state, hPos + (i+1)*PIXELS_PER_GROUP);
-						if (!dsc_state->prevIsFlat && flatness_type)
-						{
-							dsc_state->prevFirstFlat = i;
-							dsc_state->prevFlatnessType = flatness_type - 1;
-							break;
-						}
-						dsc_state->prevIsFlat = flatness_type;
+						dsc_state->prevFirstFlat = i;
+						dsc_state->prevFlatnessType = flatness_type - 1;
+						break;
 					}
-				} else if (!IsFlatnessInfoSent(dsc_cfg, qp)
-					&& ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP)==3))
-				{
-					dsc_state->prevFirstFlat = -1;
-				}
-				else if ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP)==0)
-				{
-					dsc_state->firstFlat = dsc_state->prevFirstFlat;
-					dsc_state->flatnessType = dsc_state->prevFlatnessType;
+					dsc_state->prevIsFlat = flatness_type;
 				}
-				dsc_state->origIsFlat = 0;
-				if ((dsc_state->firstFlat >= 0) &&
-				    ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP) == dsc_state->firstFlat))
-					dsc_state->origIsFlat = 1;
+			} else if (!IsFlatnessInfoSent(dsc_cfg, qp)
+				&& ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP)==3))
+			{
+				dsc_state->prevFirstFlat = -1;
 			}
+			else if ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP)==0)
+			{
+				dsc_state->firstFlat = dsc_state->prevFirstFlat;
+				dsc_state->flatnessType = dsc_state->prevFlatnessType;
+			}
+			dsc_state->origIsFlat = 0;
+			if ((dsc_state->firstFlat >= 0) &&
+			    ((dsc_state->groupCount % GROUPS_PER_SUPERGROUP) == dsc_state->firstFlat))
+				dsc_state->origIsFlat = 1;
+		}
 
-			// *MODEL NOTE* MN_FLAT_QP_ADJ
-			if (dsc_state->origIsFlat && (dsc_state->masterQp < dsc_cfg->rc_range_parameters[NUM_BUF_RANGES-1].range_max_qp))
+		// *MODEL NOTE* MN_FLAT_QP_ADJ
+		if (dsc_state->origIsFlat && (dsc_state->masterQp < dsc_cfg->rc_range_parameters[NUM_BUF_RANGES-1].range_max_qp))
+		{
+			if ((dsc_state->flatnessType==0) || (dsc_state->masterQp<SOMEWHAT_FLAT_QP_THRESH(bpc))) // Somewhat flat
 			{
-				if ((dsc_state->flatnessType==0) || (dsc_state->masterQp<SOMEWHAT_FLAT_QP_THRESH)) // Somewhat flat
-				{
-					dsc_state->stQp = MAX(dsc_state->stQp - 4, 0);
-					qp = MAX(new_quant-4, 0);
-				} else {		// very flat
-					dsc_state->stQp = 1+(2*(dsc_cfg->bits_per_component-8));
-					qp = 1+(2*(dsc_cfg->bits_per_component-8));
-				}
+				dsc_state->stQp = MAX(dsc_state->stQp - 4, 0);
+				qp = MAX(new_quant-4, 0);
+			} else {		// very flat
+				dsc_state->stQp = 1+(2*(bpc-8));
+				qp = 1+(2*(bpc-8));
 			}
-			else
-				qp = new_quant;
 		}
+		else
+			qp = new_quant;
 			
 		if (!isEncoder)  // Update decoder QP
 			dsc_state->masterQp = qp;
-		else
+
+		// Pad partial group at the end of the line
+		for (i = npix; i<PIXELS_PER_GROUP; ++i)
 		{
-			if (sampModCnt == 0)
-			{
-				for (i=0; i<PIXELS_PER_GROUP; ++i)
-					dsc_state->origWithinQerr[i] = 1;
-			}
-			if (IsOrigWithinQerr(dsc_cfg, dsc_state, hPos, vPos, dsc_state->masterQp, sampModCnt))
+			// Set ICH values to the rightmost value
+			dsc_state->ichLookup[i] = dsc_state->ichLookup[npix-1];
+			for (cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++)
 			{
-				unsigned int orig[NUM_COMPONENTS];
-
-				orig[0] = dsc_state->origLine[0][PADDING_LEFT+hPos];
-				orig[1] = dsc_state->origLine[1][PADDING_LEFT+hPos];
-				orig[2] = dsc_state->origLine[2][PADDING_LEFT+hPos];
-				dsc_state->ichLookup[sampModCnt] = PickBestHistoryValue(dsc_cfg, dsc_state, hPos, orig);
-				// Have to do ICH lookup here & remember pixel values
-				HistoryLookup(dsc_cfg, dsc_state, dsc_state->ichLookup[sampModCnt], dsc_state->ichPixels[sampModCnt], hPos, (vPos==0));
-				for (cpnt=0; cpnt < NUM_COMPONENTS; ++cpnt)
-				{
-					int absErr;
-
-					absErr = abs((int)dsc_state->ichPixels[sampModCnt][cpnt] - (int)orig[cpnt]) >> (dsc_cfg->bits_per_component - 8);
-					if (sampModCnt==0) dsc_state->maxIchError[cpnt] = 0;
-					dsc_state->maxIchError[cpnt] = MAX(dsc_state->maxIchError[cpnt], absErr);
-				}
+				dsc_state->quantizedResidual[cpnt][i] = 0;
+				dsc_state->quantizedResidualMid[cpnt][i] = 0;
 			}
 		}
 
-		sampModCnt++;
-		if ( (sampModCnt >= PIXELS_PER_GROUP ) || (hPos+1 == dsc_cfg->slice_width)) {
-			// Pad partial group at the end of the line
-			if (sampModCnt < PIXELS_PER_GROUP)
-			{
-				for (i = sampModCnt; i<PIXELS_PER_GROUP; ++i)
-				{
-					// Set ICH values to the rightmost value
-					dsc_state->ichLookup[i] = dsc_state->ichLookup[sampModCnt-1];
-					for (cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++)
-					{
-						dsc_state->quantizedResidual[cpnt][i] = 0;
-						dsc_state->quantizedResidualMid[cpnt][i] = 0;
-					}
-					hPos++;
-				}
-			}
+		dsc_state->hPos = hLast;
 
-			dsc_state->hPos = hPos;
+		if ( isEncoder ) {
+			// Code the group
+			VLCGroup( dsc_cfg, dsc_state );
+			if (dsc_state->error)
+				break;
 
-			if ( isEncoder ) {
-				// Code the group
-				VLCGroup( dsc_cfg, dsc_state, &cmpr_buf);
+			// If it turned out we needed midpoint prediction, change the reconstructed pixels to use midpoint results
+			UpdateMidpoint(dsc_cfg, dsc_state, currLine);
 
-				// If it turned out we needed midpoint prediction, change the reconstructed pixels to use midpoint results
-				UpdateMidpoint(dsc_cfg, dsc_state, currLine);
+			// If it turned out that IC$ was selected, change the reconstructed pixels to use IC$ values
+			if (dsc_state->ichSelected)
+				UseICHistory(dsc_state, currLine);
 
-				// If it turned out that IC$ was selected, change the reconstructed pixels to use IC$ values
-				if (dsc_state->ichSelected)
-					UseICHistory(dsc_cfg, dsc_state, currLine);
+			for (cpnt=0; cpnt < NUM_COMPONENTS; ++cpnt)
+				dsc_state->leftRecon[cpnt] = currLine[cpnt][MIN(dsc_cfg->slice_width-1, hLast)+PADDING_LEFT];
+			
+			// Calculate scale & offset for RC
+			CalcFullnessOffset(dsc_cfg, dsc_state, vPos, group_count, &scale, &bpg_offset);
+			group_count++;
+			dsc_state->groupCount = group_count;
+			throttle_offset = dsc_state->rcXformOffset;
 
-				for (cpnt=0; cpnt < NUM_COMPONENTS; ++cpnt)
-					dsc_state->leftRecon[cpnt] = currLine[cpnt][MIN(dsc_cfg->slice_width-1, hPos)+PADDING_LEFT];
-				
-				// Calculate scale & offset for RC
-				CalcFullnessOffset(dsc_cfg, dsc_state, vPos, group_count, &scale, &bpg_offset);
-				group_count++;
-				dsc_state->groupCount = group_count;
-				throttle_offset = dsc_state->rcXformOffset;
-
-				// Do rate control
-				RateControl( dsc_cfg, dsc_state, throttle_offset, bpg_offset, group_count, scale, sampModCnt );  // Group is finished
-				new_quant = dsc_state->stQp;
-
-				if (dsc_state->bufferFullness < 0)
+			// Do rate control
+			RateControl( dsc_cfg, dsc_state, throttle_offset, bpg_offset, group_count, scale, npix );  // Group is finished
+			new_quant = dsc_state->stQp;
+
+			if (dsc_state->bufferFullness < 0)
+			{
+				if (dsc_cfg->vbr_enable)
 				{
-					if (dsc_cfg->vbr_enable)
-					{
-						dsc_state->bitsClamped += -dsc_state->bufferFullness;
-						dsc_state->bufferFullness = 0;
-					}
-					else
-					{
-						printf("The buffer model encountered an underflow.  This may have occurred due to\n");
-						printf("an excessively high programmed constant bit rate\n");
-						exit(1);
-					}
+					dsc_state->bitsClamped += -dsc_state->bufferFullness;
+					dsc_state->bufferFullness = 0;
+				}
+				else
+				{
+					printf("The buffer model encountered an underflow.  This may have occurred due to\n");
+					printf("an excessively high programmed constant bit rate\n");
+					dsc_state->error = DSC_ERR_BUFFER;
+					break;
 				}
 			}
-			else 
-			{  
-				// Calculate scale & offset for RC
-				CalcFullnessOffset(dsc_cfg, dsc_state, vPos, group_count, &scale, &bpg_offset);
-				group_count++;
-				dsc_state->groupCount = group_count;
-				throttle_offset = dsc_state->rcXformOffset;
-
-				// Do rate control
-				RateControl( dsc_cfg, dsc_state, throttle_offset, bpg_offset, group_count, scale, sampModCnt );
-				for (cpnt=0; cpnt < NUM_COMPONENTS; ++cpnt)
-					dsc_state->leftRecon[cpnt] = currLine[cpnt][MIN(dsc_cfg->slice_width-1, hPos)+PADDING_LEFT];
-				new_quant = dsc_state->stQp;
-
-				if (dsc_state->bufferFullness < 0)
+		}
+		else 
+		{  
+			// Calculate scale & offset for RC
+			CalcFullnessOffset(dsc_cfg, dsc_state, vPos, group_count, &scale, &bpg_offset);
+			group_count++;
+			dsc_state->groupCount = group_count;
+			throttle_offset = dsc_state->rcXformOffset;
+
+			// Do rate control
+			RateControl( dsc_cfg, dsc_state, throttle_offset, bpg_offset, group_count, scale, npix );
+			for (cpnt=0; cpnt < NUM_COMPONENTS; ++cpnt)
+				dsc_state->leftRecon[cpnt] = currLine[cpnt][MIN(dsc_cfg->slice_width-1, hLast)+PADDING_LEFT];
+			new_quant = dsc_state->stQp;
+
+			if (dsc_state->bufferFullness < 0)
+			{
+				if (dsc_cfg->vbr_enable)
 				{
-					if (dsc_cfg->vbr_enable)
-					{
-						dsc_state->bitsClamped += -dsc_state->bufferFullness;
-						dsc_state->bufferFullness = 0;
-					}
-					else
-					{
-						printf("The buffer model encountered an underflow.  This may have occurred due to\n");
-						printf("an excessively high constant bit rate or due to an attempt to decode an\n");
-						printf("invalid DSC stream.\n");
-						exit(1);
-					}
+					dsc_state->bitsClamped += -dsc_state->bufferFullness;
+					dsc_state->bufferFullness = 0;
+				}
+				else
+				{
+					printf("The buffer model encountered an underflow.  This may have occurred due to\n");
+					printf("an excessively high constant bit rate or due to an attempt to decode an\n");
+					printf("invalid DSC stream.\n");
+					dsc_state->error = DSC_ERR_BUFFER;
+					break;
 				}
-
-				if (hPos>=dsc_cfg->slice_width-1)
-					dsc_state->groupCountLine = 0;
-				if ((hPos<dsc_cfg->slice_width-1) || (vPos<dsc_cfg->slice_height-1))  // Don't decode if we're done
-					VLDGroup( dsc_cfg, dsc_state, &cmpr_buf );
 			}
 
-			sampModCnt = 0;
+			if (hLast>=dsc_cfg->slice_width-1)
+				dsc_state->groupCountLine = 0;
+			if (!dsc_state->error && ((hLast<dsc_cfg->slice_width-1) || (vPos<dsc_cfg->slice_height-1)))  // Don't decode if we're done
+				VLDGroup( dsc_cfg, dsc_state );
+			if (dsc_state->error)
+				break;
 		}
 
 #ifdef PRINTDEBUG
 		fflush(g_fp_dbg);
 #endif
-		hPos++;
+		hPos += PIXELS_PER_GROUP;
 		if ( hPos >= dsc_cfg->slice_width ) {
-			int mod_hPos;
 			// end of line
+			// Output the finished line (midpoint and ICH substitutions are final now)
+			CommitLine(dsc_cfg, dsc_state, op, packed_out, vPos);
+
+			// reduce number of bits per sample in line buffer (in place, including the left padding
+			// which block prediction uses)
+			for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ )
+				ReduceLine( dsc_cfg, dsc_state, currLine[cpnt], PADDING_LEFT+dsc_cfg->slice_width, cpnt );
+
 			// Update block prediction based on real reconstructed values
-			for (mod_hPos=0; mod_hPos<dsc_cfg->slice_width; ++mod_hPos)
-			{
-				if (PRINT_DEBUG_RECON)
-					fprintf(g_fp_dbg, "\n%d, %d: ", mod_hPos, vPos);
-				for (cpnt = 0; cpnt < NUM_COMPONENTS; ++cpnt)
-				{
-					if (PRINT_DEBUG_RECON)
-						fprintf(g_fp_dbg, "%d ", currLine[cpnt][mod_hPos+PADDING_LEFT]);
-					BlockPredSearch( dsc_cfg, dsc_state, cpnt, currLine, mod_hPos, currLine[cpnt][mod_hPos+PADDING_LEFT] );
+			BlockPredSearch( dsc_cfg, dsc_state, currLine );
 
-					if ((vPos + dsc_cfg->ystart < op->h) && (mod_hPos + dsc_cfg->xstart < op->w))
-					{
-						switch(cpnt)
-						{
-						case 0: op->data.yuv.y[vPos+dsc_cfg->ystart][mod_hPos+dsc_cfg->xstart] = currLine[cpnt][PADDING_LEFT+mod_hPos]; break;
-						case 1: op->data.yuv.u[vPos+dsc_cfg->ystart][mod_hPos+dsc_cfg->xstart] = currLine[cpnt][PADDING_LEFT+mod_hPos]; break;
-						case 2: op->data.yuv.v[vPos+dsc_cfg->ystart][mod_hPos+dsc_cfg->xstart] = currLine[cpnt][PADDING_LEFT+mod_hPos]; break;
-						}
-					}
-				}
-#ifdef PRINTDEBUG
-				fflush(g_fp_dbg);
-#endif
+			// The finished line becomes the previous line (replicate pixels in left/right padding), and the
+			// old previous line is reused for the next line (only its left padding is ever read before written)
+			for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ )
+			{
+				int *line = currLine[cpnt];
+
+				for ( i=0; i<PADDING_LEFT; i++ )
+					line[i] = line[PADDING_LEFT];
+				for ( i=PADDING_LEFT+dsc_cfg->slice_width; i<lbufWidth; i++ )
+					line[i] = line[PADDING_LEFT+dsc_cfg->slice_width-1];
+				dsc_state->currLine[cpnt] = currLine[cpnt] = prevLine[cpnt];
+				dsc_state->prevLine[cpnt] = prevLine[cpnt] = line;
+				for ( i=0; i<PADDING_LEFT; i++ )
+					currLine[cpnt][i] = initValue[cpnt];
 			}
 
-			// reduce number of bits per sample in line buffer (replicate pixels in left/right padding)
-			for ( i=0; i<lbufWidth; i++ )
-				for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ )
-					prevLine[cpnt][i] = SampToLineBuf( dsc_cfg, dsc_state, currLine[cpnt][CLAMP(i,PADDING_LEFT,PADDING_LEFT+dsc_cfg->slice_width-1)], cpnt );
-
 			hPos = 0;
 			vPos++;
 			if (dsc_state->isEncoder)
@@ -2288,18 +2814,31 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 
 	}
 
-	if ( sampModCnt != 0 && isEncoder ) {  // Pad last unit wih 0's if needed
-		for (i = sampModCnt; i<PIXELS_PER_GROUP; ++i)
-			for (cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++)
-				dsc_state->quantizedResidual[cpnt][i] = 0;
-		VLCGroup( dsc_cfg, dsc_state, &cmpr_buf );
+	if (dsc_state->error)
+	{
+#ifdef PRINTDEBUG
+		fclose(g_fp_dbg);
+#endif
+		return (dsc_state->error);
 	}
 
 	if (dsc_state->isEncoder && dsc_cfg->muxing_mode)
 	{
-		while (dsc_state->seSizeFifo[0].fullness > 0)
-			ProcessGroupEnc(dsc_cfg, dsc_state, cmpr_buf);
+		while ((dsc_state->seSizeFifo[0].fullness > 0) && !dsc_state->error)
+		{
+			ProcessGroupEnc(dsc_cfg, dsc_state);
+			CheckFifoErrors(dsc_state);
+		}
+		if (dsc_state->error)
+		{
+#ifdef PRINTDEBUG
+			fclose(g_fp_dbg);
+#endif
+			return (dsc_state->error);
+		}
 	}
+	if (dsc_state->isEncoder)
+		bitwriter_flush(&dsc_state->bitWriter, dsc_state->postMuxNumBits);
 
 	if (dsc_state->isEncoder && dsc_cfg->vbr_enable)
 	{
@@ -2313,7 +2852,7 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 			{
 				printf("Chunk count was greater than the number of slice lines. This is an unexpected\n");
 				printf("fatal error.\n");
-				exit(1);
+				dsc_state->error = DSC_ERR_INTERNAL;
 			}
 		}
 
@@ -2323,36 +2862,96 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
 		dsc_state->chunkSizes[dsc_state->chunkCount] = MAX(0, dsc_state->postMuxNumBits / 8 - accum_bytes);
 	}
 
-	if ( dsc_cfg->convert_rgb ) {
-		// Convert YCoCg back to RGB again
-		ycocg2rgb(op, orig_op, dsc_cfg);
+	if (!dsc_state->error && isEncoder && (dsc_state->bufferFullness > ((dsc_cfg->initial_xmit_delay * dsc_cfg->bits_per_pixel) >> 4)))
+	{
+		printf("Too many bits are left in the rate buffer at the end of the slice.  This is most likely\n");
+		printf("due to an invalid RC configuration.\n");
+		dsc_state->error = DSC_ERR_RC;
 	}
+#ifdef PRINTDEBUG
+	fclose(g_fp_dbg);
+#endif
+	return (dsc_state->error);
+}
 
-	for ( cpnt = 0; cpnt<NUM_COMPONENTS; cpnt++ )
+
+//! Specialized instances of CodeSliceKernel()
+#define SLICE_KERNEL_INSTANCE(name, isEncoder, bpc, convert_rgb) \
+static int name(dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, pic_t* ip, pic_t* op, const dsc_packed_out_t *packed_out, unsigned char* cmpr_buf, int *chunk_sizes) \
+{ \
+	return (CodeSliceKernel(isEncoder, bpc, convert_rgb, dsc_cfg, dsc_state, ip, op, packed_out, cmpr_buf, chunk_sizes)); \
+}
+
+SLICE_KERNEL_INSTANCE(DecodeSlice8Ycbcr, 0, 8, 0)
+SLICE_KERNEL_INSTANCE(DecodeSlice8Rgb, 0, 8, 1)
+SLICE_KERNEL_INSTANCE(DecodeSlice10Ycbcr, 0, 10, 0)
+SLICE_KERNEL_INSTANCE(DecodeSlice10Rgb, 0, 10, 1)
+SLICE_KERNEL_INSTANCE(DecodeSlice12Ycbcr, 0, 12, 0)
+SLICE_KERNEL_INSTANCE(DecodeSlice12Rgb, 0, 12, 1)
+SLICE_KERNEL_INSTANCE(EncodeSlice8Ycbcr, 1, 8, 0)
+SLICE_KERNEL_INSTANCE(EncodeSlice8Rgb, 1, 8, 1)
+SLICE_KERNEL_INSTANCE(EncodeSlice10Ycbcr, 1, 10, 0)
+SLICE_KERNEL_INSTANCE(EncodeSlice10Rgb, 1, 10, 1)
+SLICE_KERNEL_INSTANCE(EncodeSlice12Ycbcr, 1, 12, 0)
+SLICE_KERNEL_INSTANCE(EncodeSlice12Rgb, 1, 12, 1)
+
+typedef int (*slice_kernel_t)(dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, pic_t* ip, pic_t* op, const dsc_packed_out_t *packed_out, unsigned char* cmpr_buf, int *chunk_sizes);
+
+// Indexed by [isEncoder][(bpc-8)/2][convert_rgb]
+static const slice_kernel_t SliceKernels[2][3][2] = {
+	{ { DecodeSlice8Ycbcr, DecodeSlice8Rgb }, { DecodeSlice10Ycbcr, DecodeSlice10Rgb }, { DecodeSlice12Ycbcr, DecodeSlice12Rgb } },
+	{ { EncodeSlice8Ycbcr, EncodeSlice8Rgb }, { EncodeSlice10Ycbcr, EncodeSlice10Rgb }, { EncodeSlice12Ycbcr, EncodeSlice12Rgb } }
+};
+
+
+//! Main DSC encoding and decoding algorithm
+/*! \param isEncoder Flag indicating whether to do an encode (1) or decode (0)
+    \param dsc_cfg   DSC configuration structure
+	\param dsc_state DSC state structure (buffers must have been allocated with AllocDSCState)
+	\param ip        Input picutre
+	\param op        Output picture (modified, only affects area of current slice; may be NULL if packed_out is used)
+	\param packed_out Packed buffer to write the reconstructed samples to instead of op (or NULL)
+	\param cmpr_buf  Compressed data buffer (modified for encoder)
+	\param chunk_sizes Array to hold sizes in bytes for each slice multiplexed chunk (modified for encoder)
+	\return          DSC_OK, or a DSC_ERROR code (the number of bits coded is left in dsc_state->postMuxNumBits) */
+int DSC_CodeSlice(int isEncoder, dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, pic_t* ip, pic_t* op, const dsc_packed_out_t *packed_out, unsigned char* cmpr_buf, int *chunk_sizes)
+{
+	int bpc = dsc_cfg->bits_per_component;
+
+	if ((bpc != 8) && (bpc != 10) && (bpc != 12))
 	{
-		free(currLine[cpnt]);
-		free(prevLine[cpnt]);
-		free(dsc_state->origLine[cpnt]);
-		fifo_free(&(dsc_state->shifter[cpnt]));
-		fifo_free(&(dsc_state->encBalanceFifo[cpnt]));
-		fifo_free(&(dsc_state->seSizeFifo[cpnt]));
-		free(dsc_state->history.pixels[cpnt]);
+		printf("ERROR: Bits per component must be 8, 10, or 12\n");
+		return (DSC_ERR_CONFIG);
 	}
+	return (SliceKernels[isEncoder ? 1 : 0][(bpc-8)/2][dsc_cfg->convert_rgb ? 1 : 0](dsc_cfg, dsc_state, ip, op, packed_out, cmpr_buf, chunk_sizes));
+}
 
-	free(dsc_state->prevLinePred);
-	free(dsc_state->history.valid);
 
-	if (isEncoder && (dsc_state->bufferFullness > ((dsc_cfg->initial_xmit_delay * dsc_cfg->bits_per_pixel) >> 4)))
+//! Code one slice with a temporary DSC state, exiting on any error
+/*! \param isEncoder Flag indicating whether to do an encode (1) or decode (0)
+    \param dsc_cfg   DSC configuration structure
+	\param ip        Input picutre
+	\param op        Output picture (modified, only affects area of current slice)
+	\param cmpr_buf  Compressed data buffer (modified for encoder)
+	\param chunk_sizes Array to hold sizes in bytes for each slice multiplexed chunk (modified for encoder)
+	\return          Number of bits in the slice */
+int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsigned char* cmpr_buf, int *chunk_sizes)
+{
+	dsc_state_t dsc_state;
+	int err;
+	int num_bits;
+
+	if (AllocDSCState(dsc_cfg, &dsc_state) != DSC_OK)
 	{
-		printf("Too many bits are left in the rate buffer at the end of the slice.  This is most likely\n");
-		printf("due to an invalid RC configuration.\n");
+		printf("ERROR: Failed to allocate memory for DSC state\n");
 		exit(1);
 	}
-#ifdef PRINTDEBUG
-	fclose(g_fp_dbg);
-#endif
-	return dsc_state->postMuxNumBits;
-
+	err = DSC_CodeSlice(isEncoder, dsc_cfg, &dsc_state, ip, op, NULL, cmpr_buf, chunk_sizes);
+	num_bits = dsc_state.postMuxNumBits;
+	FreeDSCState(&dsc_state);
+	if (err != DSC_OK)
+		exit(1);
+	return (num_bits);
 }
 
 
@@ -2361,21 +2960,20 @@ int DSC_Algorithm(int isEncoder, dsc_cfg_t* dsc_cfg, pic_t* ip, pic_t* op, unsig
     \param p_in      Input picture
 	\param p_out     Output picture
 	\param cmpr_buf  Pointer to empty buffer to hold compressed bitstream
-	\param temp_pic  Array of two pictures to use as temporary storage for YCoCg conversions
+	\param chunk_sizes Array to hold sizes in bytes for each slice multiplexed chunk (modified)
 	\return          Number of bits in the resulting compressed bitstream */
-int DSC_Encode(dsc_cfg_t *dsc_cfg, pic_t *p_in, pic_t *p_out, unsigned char *cmpr_buf, pic_t **temp_pic, int *chunk_sizes)
+int DSC_Encode(dsc_cfg_t *dsc_cfg, pic_t *p_in, pic_t *p_out, unsigned char *cmpr_buf, int *chunk_sizes)
 {
-	return DSC_Algorithm(1, dsc_cfg, p_in, p_out, cmpr_buf, temp_pic, chunk_sizes);
+	return DSC_Algorithm(1, dsc_cfg, p_in, p_out, cmpr_buf, chunk_sizes);
 }
 
 
 //! Wrapper function for decode
 /*! \param dsc_cfg   DSC configuration structure
 	\param p_out     Output picture
-	\param cmpr_buf  Pointer to buffer containing compressed bitstream
-	\param temp_pic  Array of two pictures to use as temporary storage for YCoCg conversions */
-void DSC_Decode(dsc_cfg_t *dsc_cfg, pic_t *p_out, unsigned char *cmpr_buf, pic_t **temp_pic)
+	\param cmpr_buf  Pointer to buffer containing compressed bitstream */
+void DSC_Decode(dsc_cfg_t *dsc_cfg, pic_t *p_out, unsigned char *cmpr_buf)
 {
-	DSC_Algorithm(0, dsc_cfg, p_out, p_out, cmpr_buf, temp_pic, NULL);
+	DSC_Algorithm(0, dsc_cfg, p_out, p_out, cmpr_buf, NULL);
 }
 
@@ -52,8 +52,11 @@
 #include "vdo.h"
 #include "dsc_types.h"
 
-int DSC_Encode(dsc_cfg_t* bdc_cfg, pic_t *p_in, pic_t* p_out, unsigned char* cmpr_buf, pic_t **temp_pic, int *chunk_sizes);
-void DSC_Decode(dsc_cfg_t* bdc_cfg, pic_t* p_out, unsigned char* cmpr_buf, pic_t **temp_pic);
+int AllocDSCState(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state);
+void FreeDSCState(dsc_state_t *dsc_state);
+int DSC_CodeSlice(int isEncoder, dsc_cfg_t* dsc_cfg, dsc_state_t *dsc_state, pic_t* ip, pic_t* op, const dsc_packed_out_t *packed_out, unsigned char* cmpr_buf, int *chunk_sizes);
+int DSC_Encode(dsc_cfg_t* bdc_cfg, pic_t *p_in, pic_t* p_out, unsigned char* cmpr_buf, int *chunk_sizes);
+void DSC_Decode(dsc_cfg_t* bdc_cfg, pic_t* p_out, unsigned char* cmpr_buf);
 
 #endif // __DSC_H_
 
@@ -47,6 +47,7 @@
 #define _DSC_TYPES_H_
 
 #include "fifo.h"
+#include "bitstream.h"
 
 #define NUM_BUF_RANGES        15
 #define NUM_COMPONENTS        3
@@ -56,6 +57,7 @@
 #define GROUPS_PER_SUPERGROUP 4
 #define BP_RANGE              10
 #define BP_SIZE				  3
+#define BP_LINE_PAD           16  // Samples of left padding in the BP search line buffers (for 16-wide SIMD loads)
 #define PRED_BLK_SIZE		  3
 #define ICH_BITS			  5
 #define ICH_SIZE			  (1<<ICH_BITS)
@@ -63,16 +65,64 @@
 #define OFFSET_FRACTIONAL_BITS  11
 #define MAX_SE_SIZE           (4*dsc_cfg->bits_per_component+4)
 #define PPS_SIZE			  128
+#define MAX_MUX_WORD_SIZE     64
 #define BP_EDGE_COUNT		  3
 #define BP_EDGE_STRENGTH      32
 #define PADDING_LEFT          5  // Pixels to pad line arrays to the left
 #define PADDING_RIGHT         5  // Pixels to pad line arrays to the right
 #define RC_SCALE_BINARY_POINT   3
-#define SOMEWHAT_FLAT_QP_THRESH (7+(2*(dsc_cfg->bits_per_component-8)))
+#define SOMEWHAT_FLAT_QP_THRESH(bpc) (7+(2*((bpc)-8)))
 #define OVERFLOW_AVOID_THRESHOLD  (-172)
 
 typedef enum { PT_MAP=0, PT_LEFT, PT_BLOCK } PRED_TYPE;
 
+#define PRED_LANES            4  // Components padded to a full SIMD vector
+
+/// Prediction for the pixels of a group: pixel k of a component is predicted as
+/// CLAMP(base + (sum of the group's earlier quantized residuals)*QuantDivisor, lo, hi)
+typedef struct group_pred_s {
+	int base[PIXELS_PER_GROUP][PRED_LANES];  ///< Prediction before the residual term
+	int lo[PIXELS_PER_GROUP][PRED_LANES];    ///< Lower clamp
+	int hi[PIXELS_PER_GROUP][PRED_LANES];    ///< Upper clamp
+	int qdiv[PRED_LANES];					///< QuantDivisor for each component (0 if the residuals are not used)
+	int leftChain;			///< BLOCK vector -1: pixels after the first predict from the reconstructed pixel to their left
+} group_pred_t;
+
+/// Quantizer settings of a group for each component (chroma components share a qlevel)
+typedef struct group_quant_s {
+	int qlevel[PRED_LANES];			///< Quantization level
+	int midpoint[PRED_LANES];		///< Midpoint predictor
+	int midMin[PRED_LANES];			///< Smallest midpoint residual that fits the max residual size
+	int midMax[PRED_LANES];			///< Largest midpoint residual that fits the max residual size
+	int maxval[PRED_LANES];			///< Largest sample value
+} group_quant_t;
+
+/// Packed output formats for reconstructed samples (components in coded order: RGB, or Y/Cb/Cr)
+typedef enum {
+	PACK_RGB8 = 0,			///< Interleaved, 8 bits per sample (top 8 bits of each sample)
+	PACK_RGB16,				///< Interleaved, 16 bits per sample (native byte order)
+	PACK_PLANAR8,			///< One plane per component, 8 bits per sample (top 8 bits of each sample)
+	PACK_PLANAR16			///< One plane per component, 16 bits per sample (native byte order)
+} PACK_FORMAT;
+
+/// Caller-supplied buffer that reconstructed lines are written to instead of a pic_t
+typedef struct dsc_packed_out_s {
+	PACK_FORMAT format;		///< Sample layout
+	unsigned char *buf;		///< Address of the top-left sample of the picture
+	int stride;				///< Bytes from one row to the next (within a plane for planar formats)
+	int plane_stride;		///< Bytes from one plane to the next (planar formats only)
+} dsc_packed_out_t;
+
+/// Return codes for the codec core (and libdsc)
+typedef enum {
+	DSC_OK = 0,
+	DSC_ERR_NOMEM = -1,		///< Memory allocation failed
+	DSC_ERR_CONFIG = -2,	///< Invalid configuration or picture format
+	DSC_ERR_RC = -3,		///< Rate control model failure
+	DSC_ERR_BUFFER = -4,	///< Rate buffer overflow or underflow (or invalid stream)
+	DSC_ERR_INTERNAL = -5	///< Unexpected internal inconsistency
+} DSC_ERROR;
+
 #define NUM_PRED_TYPES        (PT_BLOCK+BP_RANGE)
 
 /// Configuration for a single RC model range
@@ -125,10 +175,13 @@ typedef struct dsc_cfg_s {
 	int  pps_identifier;		///< Placeholder for PPS identifier
 } dsc_cfg_t;
 
+#define ICH_PACK(p)           ((unsigned long long)(p)[0] | ((unsigned long long)(p)[1] << 16) | ((unsigned long long)(p)[2] << 32))
+#define ICH_UNPACK(w, cpnt)   ((unsigned int)((w) >> (16*(cpnt))) & 0xffff)
+
 /// The ICH state
 typedef struct dsc_history_s {
-	unsigned int *pixels[NUM_COMPONENTS];  ///< Array of pixels that corresponds to the shift register (position 0 is MRU)
-	int *valid;				  ///< Valid bits for each pixel in the history (position 0 is MRU)
+	unsigned long long pixels[ICH_SIZE];  ///< Shift register of pixels packed with ICH_PACK (position 0 is MRU)
+	unsigned int valid;		  ///< Bit i is set if entry i of the history is valid
 } dsc_history_t;
 
 /// The DSC state
@@ -146,7 +199,6 @@ typedef struct dsc_state_s {
 	int nonFirstLineBpgTarget;  ///< Bits/group target for non-first-lines
 	int currentScale;		///< Current scale factor used for RC model
 	int scaleAdjustCounter;  ///< Counter used to compute when to adjust scale factor
-	int predErr[NUM_COMPONENTS][BP_RANGE];   ///< Errors for all pred types for each component
 	int stQp;				///< QP from RC
 	int prevQp;		  		///< QP for previous group from RC
 	int quantizedResidual[MAX_UNITS_PER_GROUP][SAMPLES_PER_UNIT];  ///< Quantized residuals for current group
@@ -160,6 +212,8 @@ typedef struct dsc_state_s {
 	int lastEdgeCount;		///< How long ago we saw the last edge (for BP)
 	int edgeDetected;       ///< Was an edge detected for BP
 	int lastErr[NUM_COMPONENTS][BP_SIZE][BP_RANGE];  ///< 3-pixel SAD's for each of the past 3 3-pixel-wide prediction blocks for each BP offset
+	short *bpLine[NUM_COMPONENTS];      ///< Current line reduced to line buffer precision for BP search (BP_LINE_PAD samples of left padding)
+	short *bpBlockSad[NUM_COMPONENTS];  ///< 3-pixel SAD's for each prediction block of the line and each BP offset
 	dsc_history_t history;	///< The ICH
 	int hPos;				///< Current horizontal position within the slice
 	int vPos;				///< Current vertical position within the slice
@@ -174,8 +228,12 @@ typedef struct dsc_state_s {
 	int *prevLine[NUM_COMPONENTS];  ///< Previous line reconstructed samples 
 	int *currLine[NUM_COMPONENTS];  ///< Current line reconstructed samples
 	int *origLine[NUM_COMPONENTS];  ///< Current line original samples (for encoder)
+	int *outLine[NUM_COMPONENTS];   ///< Current line converted back to RGB (for packed output)
 	int origWithinQerr[PIXELS_PER_GROUP];   ///< Encoder flags indicating that original pixels are within the quantization error
 	unsigned int ichPixels[PIXELS_PER_GROUP][NUM_COMPONENTS];  ///< ICH pixel samples selected for current group (for encoder)
+	short ichSnapPixels[NUM_COMPONENTS][ICH_SIZE];  ///< Snapshot of the ICH entries (incl. UL/U/UR) for the current group (for encoder search)
+	short ichSnapValid[ICH_SIZE];  ///< -1 for valid entries in the snapshot, 0 otherwise
+	int ichSnapGroup;       ///< Group the snapshot was taken for (vPos*slice_width + hPos/3), -1 if none
 	int leftRecon[NUM_COMPONENTS];		///< Previous group's rightmost reconstructed samples (used for midpoint prediction)
 	int cpntBitDepth[NUM_COMPONENTS];   ///< Bit depth for each component
 	int origIsFlat;			///< Flag indicating that original pixels are flat for this group
@@ -193,6 +251,10 @@ typedef struct dsc_state_s {
 	fifo_t shifter[NUM_COMPONENTS];		///< Decoder funnel shifter
 	fifo_t encBalanceFifo[NUM_COMPONENTS];	///< Encoder balance FIFO's
 	fifo_t seSizeFifo[NUM_COMPONENTS];	///< Syntax element sizes
+	unsigned long long seData[NUM_COMPONENTS];  ///< Syntax element bits for the current group (muxing_mode 0 only)
+	int seBits[NUM_COMPONENTS];		///< Number of bits in seData
+	bitwriter_t bitWriter;	///< Output bitstream writer (for encoder)
+	bitreader_t bitReader;	///< Input bitstream reader (for decoder)
 	int forceMpp;			///< Flag to force MPP mode to prevent underflow
 	int *quantTableLuma;	///< Quantization table for luma
 	int *quantTableChroma;	///< Quantization table for chroma
@@ -205,6 +267,7 @@ typedef struct dsc_state_s {
 	int chunkPixelTimes;    ///< Number of pixels that have been generated for the current slice line
 	int rcOffsetClampEnable; ///< Set to true after rcXformOffset falls below final_offset - rc_model_size
 	int scaleIncrementStart; ///< Flag indicating that the scale increment has started
+	int error;				///< DSC_OK, or the DSC_ERROR code of a fatal model error
 } dsc_state_t;
 
 #endif // __DSC_TYPES_H_
@@ -66,33 +66,6 @@ int ceil_log2(int val)
 }
 
 
-//! Put bits into a buffer in memory
-/*! \param val		 Value to write
-    \param size		 Number of bits to write
-	\param buf       Pointer to buffer location
-	\param bit_count Bit index into buffer (modified) */
-void putbits(int val, int size, unsigned char *buf, int *bit_count)
-{
-	int i;
-	int curbit;
-	int bitcntmod8;
-	int bufidx;
-
-	if(size>32)
-		printf("error: putbits supports max of 32 bits\n");
-	for(i=size-1; i>=0; --i)
-	{
-		bitcntmod8 = (*bit_count)%8;
-		bufidx = (*bit_count)>>3;
-		curbit = (val >> i) & 1;
-		if(bitcntmod8 == 0)
-			buf[bufidx] = 0;		// Zero current byte
-		if(curbit)
-			buf[bufidx] |= (1<<(7-bitcntmod8));
-		(*bit_count)++;
-	}
-}
-
 //! Read bits from a buffer in memory
 /*! \param size		 Number of bits to read
     \param buf       Pointer to compressed bits buffer
@@ -148,195 +121,83 @@ void *pcreateb(int format, int color, int chroma, int w, int h, int bits)
 }
 
 
-//! Convert a slice's worth of data from RGB to YCoCg
-/*! \param ip		 Input picture
-	\param op        Output picture
-	\param dsc_cfg   BDC configuration structure (specifying slice characteristics) */
-void rgb2ycocg(pic_t *ip, pic_t *op, dsc_cfg_t *dsc_cfg)
+//! Convert a line of samples from RGB to YCoCg (in place)
+/*! \param r         Red samples (replaced by Y)
+	\param g         Green samples (replaced by Co)
+	\param b         Blue samples (replaced by Cg)
+	\param n         Number of samples
+	\param bits      Bits per component of the RGB samples */
+void rgb2ycocg_line(int *r, int *g, int *b, int n, int bits)
 {
-	int i, j;
-	int r, g, b;
-	int y, co, cg;
-	int half;
-
-	if (ip->chroma != YUV_444)
-	{
-		fprintf(stderr, "ERROR: rgb2yuv() Incorrect input chroma type.\n");
-		exit(1);
-	}
-
-	if (ip->color != RGB)
-	{
-		fprintf(stderr, "ERROR: rgb2yuv() Incorrect input color type.\n");
-		exit(1);
-	}
-
-	if (ip->w != op->w || ip->h != op->h)
-	{
-		fprintf(stderr, "ERROR: rgb2yuv() Incorrect picture size.\n");
-		exit(1);
-	}
-
-	if (op->chroma != YUV_444)
-	{
-		fprintf(stderr, "ERROR: rgb2yuv() Incorrect output chroma type.\n");
-		exit(1);
-	}
+	int i;
+	int y, co, cg, t;
+	int half = 1 << (bits - 1);
 
-	if (op->color != YUV_SD && op->color != YUV_HD)
+	for (i = 0; i < n; i++)
 	{
-		fprintf(stderr, "ERROR: rgb2yuv() Incorrect output color type.\n");
-		exit(1);
-	}
-
-	switch (ip->bits) {
-	case 8:
-		half  = 128;
-		break;
-	case 10:
-		half  = 512;
-		break;
-	case 12:
-		half = 2048;
-		break;
-	default:
-		fprintf(stderr, "ERROR: rgb2yuv() Unsupported bit resolution (bits=%d).\n", ip->bits);
-		exit(1);
-		break;
-	}
+		// *MODEL NOTE* MN_ENC_CSC
+		co = r[i] - b[i];
+		t = b[i] + (co>>1);
+		cg = g[i] - t;
+		y = t + (cg>>1);
 
-
-	for (i = dsc_cfg->ystart; i < dsc_cfg->ystart + dsc_cfg->slice_height; i++)
-	{
-		if(i >= ip->h)
-			break;
-		for (j = dsc_cfg->xstart; j < dsc_cfg->xstart + dsc_cfg->slice_width; j++)
-		{
-			int t;
-			if(j >= ip->w)
-				break;
-			r = ip->data.rgb.r[i][j];
-			g = ip->data.rgb.g[i][j];
-			b = ip->data.rgb.b[i][j];
-
-			// *MODEL NOTE* MN_ENC_CSC
-			co = r - b;
-			t = b + (co>>1);
-			cg = g - t;
-			y = t + (cg>>1);
-
-			op->data.yuv.y[i][j] = y;
+		r[i] = y;
 #ifdef REDUCE_CHROMA_12BPC
-			if(ip->bits == 12)
-			{
-				op->data.yuv.u[i][j] = ((co+1)>>1) + half;
-				op->data.yuv.v[i][j] = ((cg+1)>>1) + half;
-			}
-			else 
+		if(bits == 12)
+		{
+			g[i] = ((co+1)>>1) + half;
+			b[i] = ((cg+1)>>1) + half;
+		}
+		else 
 #endif
-			{
-				op->data.yuv.u[i][j] = co + half*2;
-				op->data.yuv.v[i][j] = cg + half*2;
-			}
+		{
+			g[i] = co + half*2;
+			b[i] = cg + half*2;
 		}
 	}
 }
 
-//! Convert a slice's worth of data from YCoCg to RGB
-/*! \param ip		 Input picture
-	\param op        Output picture
-	\param dsc_cfg   BDC configuration structure (specifying slice characteristics) */
-void ycocg2rgb(pic_t *ip, pic_t *op, dsc_cfg_t* dsc_cfg)
-{
-	int i, j;
-	int y, co, cg, r, g, b;
-	int half, max;
-
-	if (ip->chroma != YUV_444)
-	{
-		fprintf(stderr, "ERROR: Incorrect input chroma type.\n");
-		exit(1);
-	}
-
-	if (ip->color != YUV_SD && ip->color != YUV_HD)
-	{
-		fprintf(stderr, "ERROR: Incorrect input color type.\n");
-		exit(1);
-	}
-
-	if (ip->w != op->w || ip->h != op->h)
-	{
-		fprintf(stderr, "ERROR: Incorrect picture size.\n");
-		exit(1);
-	}
-
-	if (op->chroma != YUV_444)
-	{
-		fprintf(stderr, "ERROR: Incorrect output chroma type.\n");
-		exit(1);
-	}
-
-	if (op->color != RGB)
-	{
-		fprintf(stderr, "ERROR: Incorrect output color type.\n");
-		exit(1);
-	}
-
 
-	switch (ip->bits) {
-	case 8:
-		half  = 128;
-		max   = 255;
-		break;
-	case 10:
-		half  = 512;
-		max   = 1023;
-		break;
-	case 12:
-		half = 2048;
-		max = 4095;
-		break;
-	default:
-		fprintf(stderr, "ERROR: Unsupported bit resolution (bits=%d).\n", ip->bits);
-		exit(1);
-		break;
-	}
+//! Convert a line of samples from YCoCg to RGB
+/*! \param y         Y samples
+	\param co        Co samples
+	\param cg        Cg samples
+	\param n         Number of samples
+	\param bits      Bits per component of the RGB samples
+	\param r         Red samples (output)
+	\param g         Green samples (output)
+	\param b         Blue samples (output) */
+void ycocg2rgb_line(const int *y, const int *co, const int *cg, int n, int bits, int *r, int *g, int *b)
+{
+	int i;
+	int c0, c1, t, rr, gg, bb;
+	int half = 1 << (bits - 1);
+	int max = (1 << bits) - 1;
 
-	for (i = dsc_cfg->ystart; i < dsc_cfg->ystart + dsc_cfg->slice_height; i++)
+	for (i = 0; i < n; i++)
 	{
-		if(i >= ip->h)
-			break;
-		for (j = dsc_cfg->xstart; j < dsc_cfg->xstart + dsc_cfg->slice_width; j++)
-		{
-			int t;
-
-			if(j>=ip->w)
-				break;
-
-			// *MODEL NOTE* MN_DEC_CSC
-			y = ip->data.yuv.y[i][j];
+		// *MODEL NOTE* MN_DEC_CSC
 #ifdef REDUCE_CHROMA_12BPC
-			if(ip->bits==12)
-			{
-				co = (ip->data.yuv.u[i][j] - half) << 1;
-				cg = (ip->data.yuv.v[i][j] - half) << 1;
-			}
-			else
+		if(bits==12)
+		{
+			c0 = (co[i] - half) << 1;
+			c1 = (cg[i] - half) << 1;
+		}
+		else
 #endif
-			{
-				co = ip->data.yuv.u[i][j] - half*2;
-				cg = ip->data.yuv.v[i][j] - half*2;
-			}
+		{
+			c0 = co[i] - half*2;
+			c1 = cg[i] - half*2;
+		}
 
-			t = y - (cg>>1);
-			g = cg+t;
-			b = t - (co>>1);
-			r = co+b;
+		t = y[i] - (c1>>1);
+		gg = c1+t;
+		bb = t - (c0>>1);
+		rr = c0+bb;
 
-			op->data.rgb.r[i][j] = CLAMP(r, 0, max);
-			op->data.rgb.g[i][j] = CLAMP(g, 0, max);
-			op->data.rgb.b[i][j] = CLAMP(b, 0, max);
-		}
+		r[i] = CLAMP(rr, 0, max);
+		g[i] = CLAMP(gg, 0, max);
+		b[i] = CLAMP(bb, 0, max);
 	}
 }
 
@@ -347,6 +208,7 @@ void ycocg2rgb(pic_t *ip, pic_t *op, dsc_cfg_t* dsc_cfg)
 void simple422to444(pic_t *ip, pic_t *op)
 {
 	int i, j;
+	int *tmp, *y, *u, *v, *oy, *ou, *ov;
 
 	// *MODEL NOTE* MN_SIMPLE_422_444
 	if((ip->w != op->w) || (ip->h != op->h))
@@ -360,21 +222,37 @@ void simple422to444(pic_t *ip, pic_t *op)
 		exit(1);
 	}
 
+	tmp = (int *)malloc(6 * ip->w * sizeof(int));
+	if (tmp == NULL)
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
 	for(i=0; i<ip->h; ++i)
 	{
+		y = prow_get(ip, 0, i, tmp);
+		u = prow_get(ip, 1, i, tmp + ip->w);
+		v = prow_get(ip, 2, i, tmp + 2*ip->w);
+		oy = prow_target(op, 0, i, tmp + 3*ip->w);
+		ou = prow_target(op, 1, i, tmp + 4*ip->w);
+		ov = prow_target(op, 2, i, tmp + 5*ip->w);
 		for(j=0; j<ip->w; ++j)
 		{
-			op->data.yuv.y[i][j] = ip->data.yuv.y[i][j];
+			oy[j] = y[j];
 			if((j%2) && (j<ip->w-1))
 			{
-				op->data.yuv.u[i][j] = (ip->data.yuv.u[i][j/2] + ip->data.yuv.u[i][j/2+1]) >> 1;
-				op->data.yuv.v[i][j] = (ip->data.yuv.v[i][j/2] + ip->data.yuv.v[i][j/2+1]) >> 1;
+				ou[j] = (u[j/2] + u[j/2+1]) >> 1;
+				ov[j] = (v[j/2] + v[j/2+1]) >> 1;
 			} else {
-				op->data.yuv.u[i][j] = ip->data.yuv.u[i][j/2];
-				op->data.yuv.v[i][j] = ip->data.yuv.v[i][j/2];
+				ou[j] = u[j/2];
+				ov[j] = v[j/2];
 			}
 		}
+		prow_put(op, 0, i, oy);
+		prow_put(op, 1, i, ou);
+		prow_put(op, 2, i, ov);
 	}
+	free(tmp);
 }
 
 
@@ -384,6 +262,7 @@ void simple422to444(pic_t *ip, pic_t *op)
 void simple444to422(pic_t *ip, pic_t *op)
 {
 	int i, j;
+	int *tmp, *y, *u, *v, *oy, *ou, *ov;
 
 	// *MODEL NOTE* MN_SIMPLE_444_422
 	if((ip->w != op->w) || (ip->h != op->h))
@@ -397,18 +276,34 @@ void simple444to422(pic_t *ip, pic_t *op)
 		exit(1);
 	}
 
+	tmp = (int *)malloc(6 * ip->w * sizeof(int));
+	if (tmp == NULL)
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
 	for(i=0; i<ip->h; ++i)
 	{
+		y = prow_get(ip, 0, i, tmp);
+		u = prow_get(ip, 1, i, tmp + ip->w);
+		v = prow_get(ip, 2, i, tmp + 2*ip->w);
+		oy = prow_target(op, 0, i, tmp + 3*ip->w);
+		ou = prow_target(op, 1, i, tmp + 4*ip->w);
+		ov = prow_target(op, 2, i, tmp + 5*ip->w);
 		for(j=0; j<ip->w; ++j)
 		{
-			op->data.yuv.y[i][j] = ip->data.yuv.y[i][j];
+			oy[j] = y[j];
 			if((j%2)==0)
 			{
-				op->data.yuv.u[i][j/2] = ip->data.yuv.u[i][j];
-				op->data.yuv.v[i][j/2] = ip->data.yuv.v[i][j];
+				ou[j/2] = u[j];
+				ov[j/2] = v[j];
 			}
 		}
+		prow_put(op, 0, i, oy);
+		prow_put(op, 1, i, ou);
+		prow_put(op, 2, i, ov);
 	}
+	free(tmp);
 }
 
 /*!
@@ -503,60 +398,63 @@ void write_pps(unsigned char *buf, dsc_cfg_t *dsc_cfg)
 {
 	int nbits = 0;
 	int i;
-
-	putbits(1, 4, buf, &nbits);   // dsc_version_major
-	putbits(1, 4, buf, &nbits);   // dsc_version_minor
-	putbits(dsc_cfg->pps_identifier, 8, buf, &nbits);
-	putbits(0, 8, buf, &nbits);   // reserved
-	putbits(dsc_cfg->bits_per_component, 4, buf, &nbits);
-	putbits(dsc_cfg->linebuf_depth, 4, buf, &nbits);
-	putbits(0, 2, buf, &nbits);   // reserved
-	putbits(dsc_cfg->block_pred_enable, 1, buf, &nbits);
-	putbits(dsc_cfg->convert_rgb, 1, buf, &nbits);
-	putbits(dsc_cfg->enable_422, 1, buf, &nbits);
-	putbits(dsc_cfg->vbr_enable, 1, buf, &nbits);
-	putbits(dsc_cfg->bits_per_pixel, 10, buf, &nbits);
-	putbits(dsc_cfg->pic_height, 16, buf, &nbits);
-	putbits(dsc_cfg->pic_width, 16, buf, &nbits);
-	putbits(dsc_cfg->slice_height, 16, buf, &nbits);
-	putbits(dsc_cfg->slice_width, 16, buf, &nbits);
-	putbits(dsc_cfg->chunk_size, 16, buf, &nbits);
-	putbits(0, 6, buf, &nbits);   // reserved
-	putbits(dsc_cfg->initial_xmit_delay, 10, buf, &nbits);
-	putbits(dsc_cfg->initial_dec_delay, 16, buf, &nbits);
-	putbits(0, 10, buf, &nbits);   // reserved
-	putbits(dsc_cfg->initial_scale_value, 6, buf, &nbits);
-	putbits(dsc_cfg->scale_increment_interval, 16, buf, &nbits);
-	putbits(0, 4, buf, &nbits);   // reserved
-	putbits(dsc_cfg->scale_decrement_interval, 12, buf, &nbits);
-	putbits(0, 11, buf, &nbits);   // reserved
-	putbits(dsc_cfg->first_line_bpg_ofs, 5, buf, &nbits);
-	putbits(dsc_cfg->nfl_bpg_offset, 16, buf, &nbits);
-	putbits(dsc_cfg->slice_bpg_offset, 16, buf, &nbits);
-	putbits(dsc_cfg->initial_offset, 16, buf, &nbits);
-	putbits(dsc_cfg->final_offset, 16, buf, &nbits);
-	putbits(0, 3, buf, &nbits);   // reserved
-	putbits(dsc_cfg->flatness_min_qp, 5, buf, &nbits);
-	putbits(0, 3, buf, &nbits);   // reserved
-	putbits(dsc_cfg->flatness_max_qp, 5, buf, &nbits);
+	bitwriter_t bw;
+
+	bitwriter_init(&bw, buf);
+	bitwriter_put_bits(&bw, 1, 4, &nbits);   // dsc_version_major
+	bitwriter_put_bits(&bw, 1, 4, &nbits);   // dsc_version_minor
+	bitwriter_put_bits(&bw, dsc_cfg->pps_identifier, 8, &nbits);
+	bitwriter_put_bits(&bw, 0, 8, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->bits_per_component, 4, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->linebuf_depth, 4, &nbits);
+	bitwriter_put_bits(&bw, 0, 2, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->block_pred_enable, 1, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->convert_rgb, 1, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->enable_422, 1, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->vbr_enable, 1, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->bits_per_pixel, 10, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->pic_height, 16, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->pic_width, 16, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->slice_height, 16, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->slice_width, 16, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->chunk_size, 16, &nbits);
+	bitwriter_put_bits(&bw, 0, 6, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->initial_xmit_delay, 10, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->initial_dec_delay, 16, &nbits);
+	bitwriter_put_bits(&bw, 0, 10, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->initial_scale_value, 6, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->scale_increment_interval, 16, &nbits);
+	bitwriter_put_bits(&bw, 0, 4, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->scale_decrement_interval, 12, &nbits);
+	bitwriter_put_bits(&bw, 0, 11, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->first_line_bpg_ofs, 5, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->nfl_bpg_offset, 16, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->slice_bpg_offset, 16, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->initial_offset, 16, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->final_offset, 16, &nbits);
+	bitwriter_put_bits(&bw, 0, 3, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->flatness_min_qp, 5, &nbits);
+	bitwriter_put_bits(&bw, 0, 3, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->flatness_max_qp, 5, &nbits);
 
 	// RC parameter set
-	putbits(dsc_cfg->rc_model_size, 16, buf, &nbits);
-	putbits(0, 4, buf, &nbits);   // reserved
-	putbits(dsc_cfg->rc_edge_factor, 4, buf, &nbits);
-	putbits(0, 3, buf, &nbits);   // reserved
-	putbits(dsc_cfg->rc_quant_incr_limit0, 5, buf, &nbits);
-	putbits(0, 3, buf, &nbits);   // reserved
-	putbits(dsc_cfg->rc_quant_incr_limit1, 5, buf, &nbits);
-	putbits(dsc_cfg->rc_tgt_offset_hi, 4, buf, &nbits);
-	putbits(dsc_cfg->rc_tgt_offset_lo, 4, buf, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->rc_model_size, 16, &nbits);
+	bitwriter_put_bits(&bw, 0, 4, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->rc_edge_factor, 4, &nbits);
+	bitwriter_put_bits(&bw, 0, 3, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->rc_quant_incr_limit0, 5, &nbits);
+	bitwriter_put_bits(&bw, 0, 3, &nbits);   // reserved
+	bitwriter_put_bits(&bw, dsc_cfg->rc_quant_incr_limit1, 5, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->rc_tgt_offset_hi, 4, &nbits);
+	bitwriter_put_bits(&bw, dsc_cfg->rc_tgt_offset_lo, 4, &nbits);
 
 	for(i=0; i<14; ++i)
-		putbits(dsc_cfg->rc_buf_thresh[i]>>6, 8, buf, &nbits);
+		bitwriter_put_bits(&bw, dsc_cfg->rc_buf_thresh[i]>>6, 8, &nbits);
 	for(i=0; i<15; ++i)
 	{
-		putbits(dsc_cfg->rc_range_parameters[i].range_min_qp, 5, buf, &nbits);
-		putbits(dsc_cfg->rc_range_parameters[i].range_max_qp, 5, buf, &nbits);
-		putbits(dsc_cfg->rc_range_parameters[i].range_bpg_offset, 6, buf, &nbits);
+		bitwriter_put_bits(&bw, dsc_cfg->rc_range_parameters[i].range_min_qp, 5, &nbits);
+		bitwriter_put_bits(&bw, dsc_cfg->rc_range_parameters[i].range_max_qp, 5, &nbits);
+		bitwriter_put_bits(&bw, dsc_cfg->rc_range_parameters[i].range_bpg_offset, 6, &nbits);
 	}
+	bitwriter_flush(&bw, nbits);
 }
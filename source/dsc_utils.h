@@ -50,13 +50,12 @@
 #include "dsc_types.h"
 //#define REDUCE_CHROMA_12BPC
 
-void putbits(int val, int size, unsigned char *buf, int *bit_count);
 int getbits(int size, unsigned char *buf, int *bit_count, int sign_extend);
 
 void *pcreateb(int format, int color, int chroma, int w, int h, int bits);
 
-void rgb2ycocg(pic_t *ip, pic_t *op, dsc_cfg_t *bdc_cfg);
-void ycocg2rgb(pic_t *ip, pic_t *op, dsc_cfg_t* bdc_cfg);
+void rgb2ycocg_line(int *r, int *g, int *b, int n, int bits);
+void ycocg2rgb_line(const int *y, const int *co, const int *cg, int n, int bits, int *r, int *g, int *b);
 
 void simple422to444(pic_t *ip, pic_t *op);
 void simple444to422(pic_t *ip, pic_t *op);
@@ -49,18 +49,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "fifo.h"
+#include "bitstream.h"
 
 //! Initialize a FIFO object
 /*! \param fifo		 Pointer to FIFO data structure
     \param size		 Specifies FIFO size in bytes */
 void fifo_init(fifo_t *fifo, int size)
 {
-	fifo->data = (unsigned char *)malloc(sizeof(unsigned char) * size);
+	int nwords = 1;
+
+	// Storage is rounded up to a power-of-two number of words so that pointers wrap with a mask
+	while (nwords * 64 < size * 8)
+		nwords <<= 1;
+	fifo->data = (unsigned long long *)calloc(nwords, sizeof(unsigned long long));
 	fifo->size = size*8;
+	fifo->ptr_mask = nwords * 64 - 1;
 	fifo->fullness = 0;
 	fifo->read_ptr = fifo->write_ptr = 0;
 	fifo->max_fullness = 0;
 	fifo->bits_added = 0;
+	fifo->error = 0;
 }
 
 
@@ -72,79 +80,223 @@ void fifo_free(fifo_t *fifo)
 }
 
 
-//! Get bits from a FIFO
+//! Empty a FIFO (keeping its storage)
+/*! \param fifo		Pointer to FIFO data structure */
+void fifo_reset(fifo_t *fifo)
+{
+	fifo->fullness = 0;
+	fifo->read_ptr = fifo->write_ptr = 0;
+	fifo->max_fullness = 0;
+	fifo->bits_added = 0;
+	fifo->error = 0;
+}
+
+
+//! Look at the next bits in a FIFO without removing them
 /*! \param fifo		Pointer to FIFO data structure 
-    \param n		Number of bits to retrieve
-	\param sign_extend Flag indicating to extend sign bit for return value
+    \param n		Number of bits to look at (1-32, must not exceed fullness)
 	\return			Value from FIFO */
-int fifo_get_bits(fifo_t *fifo, int n, int sign_extend)
+static unsigned int fifo_peek_bits(fifo_t *fifo, int n)
 {
-	unsigned int d = 0;
-	int i, pad = 0;
-	unsigned char b;
-	int sign = 0;
+	int word = fifo->read_ptr >> 6;
+	int ofs = fifo->read_ptr & 63;
+	unsigned long long d;
+
+	d = (fifo->data[word] << ofs) >> (64 - n);
+	if (n > 64 - ofs)   // Straddles two words
+		d |= fifo->data[(word + 1) & (fifo->ptr_mask >> 6)] >> (128 - ofs - n);
+	return ((unsigned int)d);
+}
+
 
+//! Remove bits from a FIFO without looking at them
+/*! On underflow the FIFO is left unchanged and its error flag is set.
+	\param fifo		Pointer to FIFO data structure 
+    \param n		Number of bits to remove */
+void fifo_skip_bits(fifo_t *fifo, int n)
+{
 	if (fifo->fullness < n)
 	{
 		printf("FIFO underflow!\n");
-		exit(1);
+		fifo->error = 1;
+		return;
 	}
+	fifo->fullness -= n;
+	fifo->read_ptr = (fifo->read_ptr + n) & fifo->ptr_mask;
+}
+
+
+//! Get bits from a FIFO
+/*! On underflow the FIFO is left unchanged, its error flag is set and 0 is returned.
+	\param fifo		Pointer to FIFO data structure 
+    \param n		Number of bits to retrieve (if more than 32, only the last 32 are returned)
+	\param sign_extend Flag indicating to extend sign bit for return value
+	\return			Value from FIFO */
+int fifo_get_bits(fifo_t *fifo, int n, int sign_extend)
+{
+	unsigned int d;
+
 	if (fifo->fullness < n)
 	{
-		pad = n - fifo->fullness;
-		n = fifo->fullness;
+		printf("FIFO underflow!\n");
+		fifo->error = 1;
+		return (0);
 	}
-
-	for (i=0; i<n; ++i)
+	if (n <= 0)
+		return (0);
+	if (n > 32)
 	{
-		b = (fifo->data[fifo->read_ptr/8] >> (7-(fifo->read_ptr%8))) & 1;
-		if (i==0) sign=b;
-		d = (d<<1) + b;
-		fifo->fullness --;
-		fifo->read_ptr ++;
-		if (fifo->read_ptr >= fifo->size)
-			fifo->read_ptr = 0;
+		fifo_skip_bits(fifo, n - 32);
+		n = 32;
 	}
 
-	if (sign_extend && sign)
+	d = fifo_peek_bits(fifo, n);
+	fifo_skip_bits(fifo, n);
+
+	if (sign_extend && (d >> (n - 1)))
+		d |= ~((1u << (n - 1) << 1) - 1);
+	return (d);
+}
+
+
+//! Get a whole word from a FIFO
+/*! If the FIFO holds fewer than nbits bits, all of them are removed and the
+    rest of the word is filled with 0's.
+	\param fifo		Pointer to FIFO data structure 
+    \param nbits	Number of bits to retrieve (1-64)
+	\return			Value from FIFO (MSB-aligned, first bit is bit 63) */
+unsigned long long fifo_get_word(fifo_t *fifo, int nbits)
+{
+	int word, ofs;
+	unsigned long long d;
+
+	if (nbits > fifo->fullness)
+		nbits = fifo->fullness;
+	if (nbits <= 0)
+		return (0);
+
+	word = fifo->read_ptr >> 6;
+	ofs = fifo->read_ptr & 63;
+	d = fifo->data[word] << ofs;
+	if (ofs && (nbits > 64 - ofs))   // Straddles two words
+		d |= fifo->data[(word + 1) & (fifo->ptr_mask >> 6)] >> (64 - ofs);
+	d &= ~0ull << (64 - nbits);
+	fifo->fullness -= nbits;
+	fifo->read_ptr = (fifo->read_ptr + nbits) & fifo->ptr_mask;
+	return (d);
+}
+
+
+//! Get a unary prefix (0's terminated by a 1) from a FIFO
+/*! Equivalent to getting one bit at a time until a 1 is found or max_prefix 0's
+    have been read.  The terminating 1 (if any) is removed from the FIFO.  If the
+	FIFO runs empty first, its error flag is set and the 0's read so far are counted.
+	\param fifo		Pointer to FIFO data structure 
+    \param max_prefix Maximum prefix value
+	\return			Number of leading 0's */
+int fifo_get_prefix(fifo_t *fifo, int max_prefix)
+{
+	int prefix = 0;
+	int n, zeros;
+	unsigned int d;
+
+	while (prefix < max_prefix)
 	{
-		int mask;
-		mask = (1<<n)-1;
-		d |= (~mask);
+		n = max_prefix - prefix;
+		if (n > 32)
+			n = 32;
+		if (n > fifo->fullness)
+			n = fifo->fullness;
+		if (n == 0)
+		{
+			printf("FIFO underflow!\n");
+			fifo->error = 1;
+			break;
+		}
+		d = fifo_peek_bits(fifo, n);
+		if (d)
+		{
+			zeros = clz32(d) - (32 - n);
+			fifo_skip_bits(fifo, zeros + 1);
+			return (prefix + zeros);
+		}
+		fifo_skip_bits(fifo, n);
+		prefix += n;
 	}
-	return (d << pad);
+	return (prefix);
 }
 
 
 //! Put bits into a FIFO
-/*! \param fifo		Pointer to FIFO data structure
+/*! On overflow nothing is added and the FIFO's error flag is set.
+	\param fifo		Pointer to FIFO data structure
 	\param d		Value to add to FIFO
-    \param n		Number of bits to add to FIFO */
+    \param nbits	Number of bits to add to FIFO (0-32) */
 void fifo_put_bits(fifo_t *fifo, unsigned int d, int nbits)
 {
-	int i;
-	unsigned char b;
+	int word = fifo->write_ptr >> 6;
+	int ofs = fifo->write_ptr & 63;
+	int spill;
+	unsigned long long v, m;
 
 	if (fifo->fullness + nbits > fifo->size)
 	{
 		printf("FIFO overflow!\n");
-		exit(1);
+		fifo->error = 1;
+		return;
 	}
 
 	fifo->bits_added += nbits;
 	fifo->fullness += nbits;
-	for (i=0; i<nbits; ++i)
+	if (nbits > 0)
 	{
-		b = (d >> (nbits-i-1)) & 1;
-		if (!b)
-			fifo->data[fifo->write_ptr/8] &= ~(1<<(7-(fifo->write_ptr%8)));
-		else
-			fifo->data[fifo->write_ptr/8] |= (1<<(7-(fifo->write_ptr%8)));
-		fifo->write_ptr++;
-		if (fifo->write_ptr >= fifo->size)
-			fifo->write_ptr = 0;
+		m = (1ull << nbits) - 1;
+		v = d & m;
+		spill = ofs + nbits - 64;
+		if (spill <= 0)
+			fifo->data[word] = (fifo->data[word] & ~(m << -spill)) | (v << -spill);
+		else   // Straddles two words
+		{
+			fifo->data[word] = (fifo->data[word] & ~(m >> spill)) | (v >> spill);
+			word = (word + 1) & (fifo->ptr_mask >> 6);
+			fifo->data[word] = (fifo->data[word] & (~0ull >> spill)) | (v << (64 - spill));
+		}
+		fifo->write_ptr = (fifo->write_ptr + nbits) & fifo->ptr_mask;
 	}
 	if (fifo->fullness > fifo->max_fullness)
 		fifo->max_fullness = fifo->fullness;
 }
 
+
+//! Put a whole word into a FIFO
+/*! On overflow nothing is added and the FIFO's error flag is set.
+	\param fifo		Pointer to FIFO data structure
+	\param d		Value to add to FIFO (MSB-aligned, first bit is bit 63)
+    \param nbits	Number of bits to add to FIFO (1-64) */
+void fifo_put_word(fifo_t *fifo, unsigned long long d, int nbits)
+{
+	int word = fifo->write_ptr >> 6;
+	int ofs = fifo->write_ptr & 63;
+	unsigned long long m;
+
+	if (fifo->fullness + nbits > fifo->size)
+	{
+		printf("FIFO overflow!\n");
+		fifo->error = 1;
+		return;
+	}
+
+	m = ~0ull << (64 - nbits);
+	d &= m;
+	fifo->data[word] = (fifo->data[word] & ~(m >> ofs)) | (d >> ofs);
+	if (ofs + nbits > 64)   // Straddles two words
+	{
+		word = (word + 1) & (fifo->ptr_mask >> 6);
+		fifo->data[word] = (fifo->data[word] & ~(m << (64 - ofs))) | (d << (64 - ofs));
+	}
+	fifo->bits_added += nbits;
+	fifo->fullness += nbits;
+	fifo->write_ptr = (fifo->write_ptr + nbits) & fifo->ptr_mask;
+	if (fifo->fullness > fifo->max_fullness)
+		fifo->max_fullness = fifo->fullness;
+}
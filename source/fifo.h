@@ -52,19 +52,26 @@
 
 typedef struct fifo_s
 {
-	unsigned char *data;
-	int size;
+	unsigned long long *data;  // Ring of 64-bit words (power-of-two count), MSB is first bit
+	int size;                  // FIFO capacity in bits
+	int ptr_mask;              // Number of storage bits - 1 (read/write pointers wrap with this)
 	int fullness;
 	int read_ptr;
 	int write_ptr;
 	int max_fullness;
 	int bits_added;
+	int error;                 // Set when a read underflowed or a write overflowed the FIFO
 } fifo_t;
 
 void fifo_init(fifo_t *fifo, int size);
 void fifo_free(fifo_t *fifo);
+void fifo_reset(fifo_t *fifo);
 int fifo_get_bits(fifo_t *fifo, int nbits, int sign_extend);
+int fifo_get_prefix(fifo_t *fifo, int max_prefix);
 void fifo_put_bits(fifo_t *fifo, unsigned int d, int nbits);
+unsigned long long fifo_get_word(fifo_t *fifo, int nbits);
+void fifo_put_word(fifo_t *fifo, unsigned long long d, int nbits);
+void fifo_skip_bits(fifo_t *fifo, int n);
 
 #endif
 
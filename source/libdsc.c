@@ -0,0 +1,198 @@
+/***************************************************************************
+*    Contributed to VESA for inclusion and use in its VESA Display Stream
+*    Compression reference model.  This file extends the Broadcom
+*    contribution and is distributed under the same terms and conditions
+*    as the rest of the model.
+***************************************************************************/
+
+/*! \file libdsc.c
+ *    Library interface to the DSC encoder/decoder with a reusable context
+ *
+ * The configuration passed in must be complete (as produced by the rate control
+ * setup in codec_main.c or by parse_pps()); xstart and ystart are supplied per slice.
+ * All functions return DSC_OK or a (negative) DSC_ERROR code.  Slices may be coded
+ * in parallel as long as each thread uses its own context. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdsc.h"
+#include "dsc_codec.h"
+
+struct dsc_context_s
+{
+	dsc_cfg_t cfg;          // Configuration (xstart/ystart are set for each slice)
+	dsc_state_t state;      // Slice state; buffers allocated by AllocDSCState
+};
+
+
+//! Check that a configuration can be used by the codec
+/*! \param dsc_cfg   DSC configuration structure
+	\return          DSC_OK or DSC_ERR_CONFIG */
+static int check_cfg(const dsc_cfg_t *dsc_cfg)
+{
+	if ((dsc_cfg->bits_per_component != 8) && (dsc_cfg->bits_per_component != 10) && (dsc_cfg->bits_per_component != 12))
+		return (DSC_ERR_CONFIG);
+	if ((dsc_cfg->slice_width <= 0) || (dsc_cfg->slice_height <= 0) || (dsc_cfg->pic_width <= 0) || (dsc_cfg->pic_height <= 0))
+		return (DSC_ERR_CONFIG);
+	if ((dsc_cfg->mux_word_size < 8) || (dsc_cfg->mux_word_size > MAX_MUX_WORD_SIZE))
+		return (DSC_ERR_CONFIG);
+	if ((dsc_cfg->chunk_size <= 0) || (dsc_cfg->linebuf_depth <= 0))
+		return (DSC_ERR_CONFIG);
+	return (DSC_OK);
+}
+
+
+//! Check that a picture matches the context's configuration
+/*! \param ctx       Codec context
+	\param p         Picture
+	\return          DSC_OK or DSC_ERR_CONFIG */
+static int check_pic(dsc_context_t *ctx, pic_t *p)
+{
+	if ((p == NULL) || (p->bits != ctx->cfg.bits_per_component))
+		return (DSC_ERR_CONFIG);
+	if (ctx->cfg.convert_rgb && ((p->color != RGB) || (p->chroma != YUV_444)))
+		return (DSC_ERR_CONFIG);
+	return (DSC_OK);
+}
+
+
+//! Create a codec context
+/*! \param dsc_cfg   DSC configuration structure (copied)
+	\param ctx       Set to the new context (or NULL on failure)
+	\return          DSC_OK, DSC_ERR_CONFIG or DSC_ERR_NOMEM */
+int dsc_create(const dsc_cfg_t *dsc_cfg, dsc_context_t **ctx)
+{
+	int err;
+
+	*ctx = NULL;
+	if ((err = check_cfg(dsc_cfg)) != DSC_OK)
+		return (err);
+	*ctx = (dsc_context_t *)calloc(1, sizeof(dsc_context_t));
+	if (*ctx == NULL)
+		return (DSC_ERR_NOMEM);
+	(*ctx)->cfg = *dsc_cfg;
+	if ((err = AllocDSCState(&(*ctx)->cfg, &(*ctx)->state)) != DSC_OK)
+	{
+		dsc_destroy(*ctx);
+		*ctx = NULL;
+	}
+	return (err);
+}
+
+
+//! Change the configuration of a codec context
+/*! Buffers are only reallocated if the new configuration needs different sizes.
+	\param ctx       Codec context
+	\param dsc_cfg   New DSC configuration structure (copied), or NULL to keep the current one
+	\return          DSC_OK, DSC_ERR_CONFIG or DSC_ERR_NOMEM */
+int dsc_reset(dsc_context_t *ctx, const dsc_cfg_t *dsc_cfg)
+{
+	int realloc_needed;
+	int err;
+
+	if (dsc_cfg == NULL)
+		return (DSC_OK);    // Each slice starts from a fresh state anyway
+	if ((err = check_cfg(dsc_cfg)) != DSC_OK)
+		return (err);
+
+	realloc_needed = (dsc_cfg->slice_width != ctx->cfg.slice_width) ||
+		(dsc_cfg->mux_word_size != ctx->cfg.mux_word_size) ||
+		(dsc_cfg->bits_per_component != ctx->cfg.bits_per_component);
+	ctx->cfg = *dsc_cfg;
+	if (!realloc_needed)
+		return (DSC_OK);
+	FreeDSCState(&ctx->state);
+	return (AllocDSCState(&ctx->cfg, &ctx->state));
+}
+
+
+//! Encode one slice
+/*! \param ctx       Codec context
+	\param xstart    Horizontal position of the slice in the picture
+	\param ystart    Vertical position of the slice in the picture
+	\param ip        Input picture
+	\param op        Reconstructed picture (modified, only affects area of the slice)
+	\param cmpr_buf  Buffer for the compressed slice (must hold chunk_size * slice_height bytes)
+	\param chunk_sizes Array to hold the size of each chunk in bytes (modified; only used for VBR)
+	\param num_bits  Set to the number of bits in the compressed slice
+	\return          DSC_OK or a DSC_ERROR code */
+int dsc_encode_slice(dsc_context_t *ctx, int xstart, int ystart, pic_t *ip, pic_t *op, unsigned char *cmpr_buf, int *chunk_sizes, int *num_bits)
+{
+	int err;
+
+	*num_bits = 0;
+	if (((err = check_pic(ctx, ip)) != DSC_OK) || ((err = check_pic(ctx, op)) != DSC_OK))
+		return (err);
+	ctx->cfg.xstart = xstart;
+	ctx->cfg.ystart = ystart;
+	err = DSC_CodeSlice(1, &ctx->cfg, &ctx->state, ip, op, NULL, cmpr_buf, chunk_sizes);
+	*num_bits = ctx->state.postMuxNumBits;
+	return (err);
+}
+
+
+//! Decode one slice
+/*! \param ctx       Codec context
+	\param xstart    Horizontal position of the slice in the picture
+	\param ystart    Vertical position of the slice in the picture
+	\param op        Output picture (modified, only affects area of the slice)
+	\param cmpr_buf  Compressed slice (chunk_size * slice_height bytes)
+	\return          DSC_OK or a DSC_ERROR code */
+int dsc_decode_slice(dsc_context_t *ctx, int xstart, int ystart, pic_t *op, unsigned char *cmpr_buf)
+{
+	int err;
+
+	if ((err = check_pic(ctx, op)) != DSC_OK)
+		return (err);
+	ctx->cfg.xstart = xstart;
+	ctx->cfg.ystart = ystart;
+	return (DSC_CodeSlice(0, &ctx->cfg, &ctx->state, op, op, NULL, cmpr_buf, NULL));
+}
+
+
+//! Decode one slice into a caller-supplied packed buffer
+/*! Each reconstructed line is written to the buffer once, as a sequential run of stores.
+	\param ctx       Codec context
+	\param xstart    Horizontal position of the slice in the picture
+	\param ystart    Vertical position of the slice in the picture
+	\param out       Packed output buffer (covers the whole picture; only the slice area is written)
+	\param cmpr_buf  Compressed slice (chunk_size * slice_height bytes)
+	\return          DSC_OK or a DSC_ERROR code */
+int dsc_decode_slice_packed(dsc_context_t *ctx, int xstart, int ystart, const dsc_packed_out_t *out, unsigned char *cmpr_buf)
+{
+	if ((out == NULL) || (out->buf == NULL) || (out->format < PACK_RGB8) || (out->format > PACK_PLANAR16))
+		return (DSC_ERR_CONFIG);
+	ctx->cfg.xstart = xstart;
+	ctx->cfg.ystart = ystart;
+	return (DSC_CodeSlice(0, &ctx->cfg, &ctx->state, NULL, NULL, out, cmpr_buf, NULL));
+}
+
+
+//! Destroy a codec context
+/*! \param ctx       Codec context (may be NULL) */
+void dsc_destroy(dsc_context_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+	FreeDSCState(&ctx->state);
+	free(ctx);
+}
+
+
+//! Get a description of a return code
+/*! \param err       DSC_OK or a DSC_ERROR code
+	\return          Description */
+const char *dsc_error_string(int err)
+{
+	switch (err)
+	{
+	case DSC_OK:			return ("no error");
+	case DSC_ERR_NOMEM:		return ("out of memory");
+	case DSC_ERR_CONFIG:	return ("invalid configuration or picture format");
+	case DSC_ERR_RC:		return ("rate control failure");
+	case DSC_ERR_BUFFER:	return ("rate buffer overflow or underflow");
+	case DSC_ERR_INTERNAL:	return ("internal error");
+	}
+	return ("unknown error");
+}
@@ -0,0 +1,29 @@
+/***************************************************************************
+*    Contributed to VESA for inclusion and use in its VESA Display Stream
+*    Compression reference model.  This file extends the Broadcom
+*    contribution and is distributed under the same terms and conditions
+*    as the rest of the model.
+***************************************************************************/
+
+/*! \file libdsc.h
+ *    Library interface to the DSC encoder/decoder with a reusable context */
+
+#ifndef LIBDSC_H
+#define LIBDSC_H
+
+#include "vdo.h"
+#include "dsc_types.h"
+
+/// Opaque codec context.  Holds a copy of the configuration and all line buffers and FIFO's,
+/// which are kept across slices and frames until the configuration changes.
+typedef struct dsc_context_s dsc_context_t;
+
+int dsc_create(const dsc_cfg_t *dsc_cfg, dsc_context_t **ctx);
+int dsc_reset(dsc_context_t *ctx, const dsc_cfg_t *dsc_cfg);
+int dsc_encode_slice(dsc_context_t *ctx, int xstart, int ystart, pic_t *ip, pic_t *op, unsigned char *cmpr_buf, int *chunk_sizes, int *num_bits);
+int dsc_decode_slice(dsc_context_t *ctx, int xstart, int ystart, pic_t *op, unsigned char *cmpr_buf);
+int dsc_decode_slice_packed(dsc_context_t *ctx, int xstart, int ystart, const dsc_packed_out_t *out, unsigned char *cmpr_buf);
+void dsc_destroy(dsc_context_t *ctx);
+const char *dsc_error_string(int err);
+
+#endif
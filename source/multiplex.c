@@ -53,34 +53,29 @@
 /*! \file multiplex.c
  *    Substream multiplex support functions */
 
-//! In normal (non-substream) mode, this function writes the contents of the shifter to the output bitstream
-/*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state Current DSC state
-	\param buf       Pointer to output buffer */
-void WriteEntryToBitstream(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *buf)
+//! In normal (non-substream) mode, this function writes the syntax elements for the current group to the output bitstream
+/*! \param dsc_state Current DSC state */
+void WriteEntryToBitstream(dsc_state_t *dsc_state)
 {
 	int i;
 	int sz;
-	unsigned int d;
 
 	for (i=0; i<NUM_COMPONENTS; ++i)
 	{
-		sz = fifo_get_bits(&(dsc_state->seSizeFifo[i]), 6, 0);
+		sz = dsc_state->seBits[i];
 		if (sz>32)
 		{
-			d = fifo_get_bits(&(dsc_state->encBalanceFifo[i]), 32, 0);
-			putbits(d, 32, buf, &dsc_state->postMuxNumBits);
+			bitwriter_put_bits(&dsc_state->bitWriter, (unsigned int)(dsc_state->seData[i] >> (sz-32)), 32, &dsc_state->postMuxNumBits);
 			sz -= 32;
 		}
-		d = fifo_get_bits(&(dsc_state->encBalanceFifo[i]), sz, 0);
-		if (dsc_state->encBalanceFifo[i].fullness!=0)
-			printf("Error: shifter underflow\n");
-		putbits(d, sz, buf, &dsc_state->postMuxNumBits);
+		bitwriter_put_bits(&dsc_state->bitWriter, (unsigned int)dsc_state->seData[i], sz, &dsc_state->postMuxNumBits);
+		dsc_state->seData[i] = 0;
+		dsc_state->seBits[i] = 0;
 	}
 }
 
 
-//! Add bits to one of the encoder FIFO's
+//! Add bits to one of the encoder FIFO's (or, in non-substream mode, to the syntax element for the current group)
 /*! \param dsc_cfg   DSC configuration structure
     \param dsc_state Current DSC state
 	\param CType	 Which component FIFO to add to
@@ -88,7 +83,14 @@ void WriteEntryToBitstream(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned
 	\param nbits     Number of bits to add */
 void AddBits(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int CType, int d, int nbits)
 {
-	fifo_put_bits(&(dsc_state->encBalanceFifo[CType]), d, nbits);
+	if (dsc_cfg->muxing_mode==0)
+	{
+		// A syntax element never exceeds MAX_SE_SIZE (52 bits at 12 bpc), so it fits in one word
+		dsc_state->seData[CType] = (dsc_state->seData[CType] << nbits) | ((unsigned int)d & ((1ULL << nbits) - 1));
+		dsc_state->seBits[CType] += nbits;
+	}
+	else
+		fifo_put_bits(&(dsc_state->encBalanceFifo[CType]), d, nbits);
 	dsc_state->numBits += nbits;
 }
 
@@ -99,29 +101,48 @@ void AddBits(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int CType, int d, int n
 	\param unit      Which substream (component) shifter to get data from
 	\param nbits     Number of bits to retrieve 
 	\param sign_extend Flag indicating whether return value should have sign bit extended
-	\param buf       Input buffer (for non-substream mode)
 	\return          Data from bitstream or shifter */
-int GetBits(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int unit, int nbits, int sign_extend, unsigned char *buf)
+int GetBits(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int unit, int nbits, int sign_extend)
 {
 	dsc_state->numBits += nbits;
 
 	if (dsc_cfg->muxing_mode==0)
-		return (getbits(nbits, buf, &dsc_state->postMuxNumBits, sign_extend));
+		return (bitreader_get_bits(&dsc_state->bitReader, nbits, sign_extend, &dsc_state->postMuxNumBits));
 
 	return (fifo_get_bits(&(dsc_state->shifter[unit]), nbits, sign_extend));
 }
 
 
-//! Process a single group through the FIFO's, and generate 0 - 3 mux words
+//! Get a unary prefix (0's terminated by a 1, up to max_prefix 0's) from the input bitstream or one of the funnel shifters
 /*! \param dsc_cfg   DSC configuration structure
     \param dsc_state Current DSC state
-	\param buf       Pointer to output buffer */
-void ProcessGroupEnc(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *buf)
+	\param unit      Which substream (component) shifter to get data from
+	\param max_prefix Maximum prefix value (no terminating 1 is read once this many 0's are read)
+	\return          Prefix value */
+int GetPrefix(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int unit, int max_prefix)
+{
+	int prefix;
+
+	if (dsc_cfg->muxing_mode==0)
+		prefix = bitreader_get_prefix(&dsc_state->bitReader, max_prefix, &dsc_state->postMuxNumBits);
+	else
+		prefix = fifo_get_prefix(&(dsc_state->shifter[unit]), max_prefix);
+	dsc_state->numBits += prefix + (prefix < max_prefix);
+	return (prefix);
+}
+
+
+//! Process a single group through the FIFO's, and generate 0 - 3 mux words
+/*! \param dsc_cfg   DSC configuration structure
+    \param dsc_state Current DSC state */
+void ProcessGroupEnc(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state)
 {
 	int i, j;
-	unsigned char d;
+	unsigned long long d;
+	unsigned char mux_word[MAX_MUX_WORD_SIZE/8];
 	int max_se_size[NUM_COMPONENTS];
-	int sz;
+	int nbytes = dsc_cfg->mux_word_size / 8;
+	int nbits = nbytes * 8;
 
 	max_se_size[0] = dsc_state->cpntBitDepth[0] * 4 + 4;  // prefix + code + up to 3 bits for flatness
 	max_se_size[1] = dsc_state->cpntBitDepth[1] * 4;  // prefix omitted
@@ -132,46 +153,33 @@ void ProcessGroupEnc(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *
 	{
 		if (dsc_state->shifter[i].fullness < max_se_size[i])
 		{
-			for (j=0; j<(dsc_cfg->mux_word_size / 8); ++j)
-			{
-				if (dsc_state->isEncoder)
-				{
-					sz = dsc_state->encBalanceFifo[i].fullness;
-					if (sz >= 8)
-						d = fifo_get_bits(&(dsc_state->encBalanceFifo[i]), 8, 0);
-					else if (sz > 0)
-						d = fifo_get_bits(&(dsc_state->encBalanceFifo[i]), sz, 0) << (8-sz);
-					else
-						d = 0;
-					putbits(d, 8, buf, &dsc_state->postMuxNumBits);
-				}
-				else  // Decoder
-				{
-					d = getbits(8, buf, &dsc_state->numBits, 0);
-				}
-				fifo_put_bits(&dsc_state->shifter[i], d, 8);				
-			}
+			// A mux word is taken from the balance FIFO in one piece (0-padded if the FIFO runs dry)
+			d = fifo_get_word(&(dsc_state->encBalanceFifo[i]), nbits);
+			for (j=0; j<nbytes; ++j)
+				mux_word[j] = (unsigned char)(d >> (56 - 8*j));
+			bitwriter_put_bytes(&dsc_state->bitWriter, mux_word, nbytes, &dsc_state->postMuxNumBits);
+			fifo_put_word(&dsc_state->shifter[i], d, nbits);
 		}
 	}
 
 	// Virtual decoder
 	for (i=0; i<NUM_COMPONENTS; ++i)
 	{
-		sz = fifo_get_bits(&(dsc_state->seSizeFifo[i]), 6, 0);
-		fifo_get_bits(&(dsc_state->shifter[i]), sz, 0);        // Remove one SE
+		fifo_skip_bits(&(dsc_state->shifter[i]), fifo_get_bits(&(dsc_state->seSizeFifo[i]), 6, 0));        // Remove one SE
 	}
 }
 
 
 //! Process a single group through the FIFO's, and insert 0 - 3 mux words in shifters
 /*! \param dsc_cfg   DSC configuration structure
-    \param dsc_state Current DSC state
-	\param buf       Pointer to input buffer */
-void ProcessGroupDec(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *buf)
+    \param dsc_state Current DSC state */
+void ProcessGroupDec(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state)
 {
-	int i, j;
-	unsigned char d;
+	int i;
+	unsigned long long d;
 	int max_se_size[NUM_COMPONENTS];
+	int nbits = (dsc_cfg->mux_word_size / 8) * 8;
+	int lo_bits = nbits - 32;
 
 	max_se_size[0] = dsc_state->cpntBitDepth[0] * 4 + 4;
 	max_se_size[1] = dsc_state->cpntBitDepth[1] * 4;  // prefix omitted
@@ -182,11 +190,14 @@ void ProcessGroupDec(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *
 	{
 		if (dsc_state->shifter[i].fullness < max_se_size[i])
 		{
-			for (j=0; j<(dsc_cfg->mux_word_size / 8); ++j)
+			if (lo_bits > 0)
 			{
-				d = getbits(8, buf, &dsc_state->postMuxNumBits, 0);
-				fifo_put_bits(&dsc_state->shifter[i], d, 8);				
+				d = (unsigned long long)(unsigned int)bitreader_get_bits(&dsc_state->bitReader, 32, 0, &dsc_state->postMuxNumBits) << 32;
+				d |= (unsigned long long)(unsigned int)bitreader_get_bits(&dsc_state->bitReader, lo_bits, 0, &dsc_state->postMuxNumBits) << (32 - lo_bits);
 			}
+			else
+				d = (unsigned long long)(unsigned int)bitreader_get_bits(&dsc_state->bitReader, nbits, 0, &dsc_state->postMuxNumBits) << (64 - nbits);
+			fifo_put_word(&dsc_state->shifter[i], d, nbits);
 		}
 	}
 }
@@ -50,10 +50,11 @@
 #define MULTIPLEX_H
 #include "dsc_types.h"
 
-void WriteEntryToBitstream(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *buf);
-void ProcessGroupEnc(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *buf);
-void ProcessGroupDec(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, unsigned char *buf);
+void WriteEntryToBitstream(dsc_state_t *dsc_state);
+void ProcessGroupEnc(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state);
+void ProcessGroupDec(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state);
 void AddBits(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int CType, int d, int nbits);
-int GetBits(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int unit, int nbits, int sign_extend, unsigned char *buf);
+int GetBits(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int unit, int nbits, int sign_extend);
+int GetPrefix(dsc_cfg_t *dsc_cfg, dsc_state_t *dsc_state, int unit, int max_prefix);
 
 #endif
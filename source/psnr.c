@@ -49,12 +49,14 @@
 #include <stdlib.h>
 #include "vdo.h"
 #include "psnr.h"
+#include "utl.h"
 #else
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "vdo.h"
 #include "psnr.h"
+#include "utl.h"
 #endif
 
 
@@ -74,6 +76,7 @@ void compute_and_display_PSNR(pic_t *p_in, pic_t *p_out, int bpp, FILE *logfp)
 	int maxErrR = 0;
 	int maxErrG = 0;
 	int maxErrB = 0;
+	int *tmp, *in[3], *out[3];
 
     
 	switch(bpp) {
@@ -98,47 +101,64 @@ void compute_and_display_PSNR(pic_t *p_in, pic_t *p_out, int bpp, FILE *logfp)
 	if (p_in->bits != p_out->bits)
 		printf("in out bits not matched\n");
 
+	// Rows are fetched as int samples, so either picture may have 16-bit planes
+	tmp = (int *)malloc(6 * p_in->w * sizeof(int));
+	if (tmp == NULL)
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
+
 	if (p_in->color == RGB) 
 	{
 		wd = p_in->w; 
 		for(ycnt=0; ycnt<p_in->h; ycnt++) 
 		{
+			for (ch=0; ch<3; ch++)
+			{
+				in[ch] = prow_get(p_in, ch, ycnt, tmp + ch*p_in->w);
+				out[ch] = prow_get(p_out, ch, ycnt, tmp + (3+ch)*p_in->w);
+			}
 			for(xcnt=0; xcnt<p_in->w; xcnt++) 
 			{
 				for (ch=0; ch<3; ch++) 
 				{
 					switch(ch) {
 					case 0:
-						err = p_out->data.rgb.r[ycnt][xcnt] - p_in->data.rgb.r[ycnt][xcnt];
+						err = out[0][xcnt] - in[0][xcnt];
 						if (abs(err) > maxErrR) {
 							maxErrR = abs(err);							
 						}			
 #ifdef GENERATE_ERROR_IMAGE
-						p_out->data.rgb.r[ycnt][xcnt] = 512 + err;
+						out[0][xcnt] = 512 + err;
 #endif										
 						break;
 					case 1:
-						err = p_out->data.rgb.g[ycnt][xcnt] - p_in->data.rgb.g[ycnt][xcnt];
+						err = out[1][xcnt] - in[1][xcnt];
 						if (abs(err) > maxErrG) {
 							maxErrG = abs(err);							
 						}							
 #ifdef GENERATE_ERROR_IMAGE
-						p_out->data.rgb.g[ycnt][xcnt] = 512 + err;
+						out[1][xcnt] = 512 + err;
 #endif										
 						break;
 					case 2:
-						err = p_out->data.rgb.b[ycnt][xcnt] - p_in->data.rgb.b[ycnt][xcnt];
+						err = out[2][xcnt] - in[2][xcnt];
 						if (abs(err) > maxErrB) {
 							maxErrB = abs(err);							
 						}							
 #ifdef GENERATE_ERROR_IMAGE
-						p_out->data.rgb.b[ycnt][xcnt] = 512 + err;
+						out[2][xcnt] = 512 + err;
 #endif										
 						break;
 					}
 					sumSqrError += (double) (err * err);
 				}				
 			}
+#ifdef GENERATE_ERROR_IMAGE
+			for (ch=0; ch<3; ch++)
+				prow_put(p_out, ch, ycnt, out[ch]);
+#endif
 		}
 		if (sumSqrError != 0) {
 			mse = sumSqrError / ((double) (p_in->h * p_in->w * 3));
@@ -153,9 +173,11 @@ void compute_and_display_PSNR(pic_t *p_in, pic_t *p_out, int bpp, FILE *logfp)
 
 		for(ycnt=0; ycnt<p_in->h; ycnt++) 
 		{
+			in[0] = prow_get(p_in, 0, ycnt, tmp);
+			out[0] = prow_get(p_out, 0, ycnt, tmp + 3*p_in->w);
 			for(xcnt=0; xcnt<p_in->w; xcnt++) 
 			{
-				err = p_out->data.yuv.y[ycnt][xcnt] - p_in->data.yuv.y[ycnt][xcnt];
+				err = out[0][xcnt] - in[0][xcnt];
 				sumSqrError += (double) (err * err);
 			}
 		}
@@ -177,9 +199,11 @@ void compute_and_display_PSNR(pic_t *p_in, pic_t *p_out, int bpp, FILE *logfp)
 		sumSqrError = 0;
 		for(ycnt=0; ycnt<p_in->h; ycnt++) 
 		{
+			in[1] = prow_get(p_in, 1, ycnt, tmp + p_in->w);
+			out[1] = prow_get(p_out, 1, ycnt, tmp + 4*p_in->w);
 			for(xcnt=0; xcnt<wd; xcnt++) 
 			{
-				err = p_out->data.yuv.u[ycnt][xcnt] - p_in->data.yuv.u[ycnt][xcnt];
+				err = out[1][xcnt] - in[1][xcnt];
 				sumSqrError += (double) (err * err);
 			}
 		}
@@ -194,9 +218,11 @@ void compute_and_display_PSNR(pic_t *p_in, pic_t *p_out, int bpp, FILE *logfp)
 		sumSqrError = 0;
 		for(ycnt=0; ycnt<p_in->h; ycnt++) 
 		{
+			in[2] = prow_get(p_in, 2, ycnt, tmp + 2*p_in->w);
+			out[2] = prow_get(p_out, 2, ycnt, tmp + 5*p_in->w);
 			for(xcnt=0; xcnt<wd; xcnt++) 
 			{
-				err = p_out->data.yuv.v[ycnt][xcnt] - p_in->data.yuv.v[ycnt][xcnt];
+				err = out[2][xcnt] - in[2][xcnt];
 				sumSqrError += (double) (err * err);
 			}
 		}
@@ -209,5 +235,6 @@ void compute_and_display_PSNR(pic_t *p_in, pic_t *p_out, int bpp, FILE *logfp)
 			fprintf(logfp,"PSNR over chroma (V) channel = Inf   \n");
 
 	}		
+	free(tmp);
 }
 
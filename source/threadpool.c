@@ -0,0 +1,249 @@
+/***************************************************************************
+*    Contributed to VESA for inclusion and use in its VESA Display Stream
+*    Compression reference model.  This file extends the Broadcom
+*    contribution and is distributed under the same terms and conditions
+*    as the rest of the model.
+***************************************************************************/
+
+/*! \file threadpool.c
+ *    Simple worker pool for running independent jobs (slices) in parallel */
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "threadpool.h"
+#include "logging.h"
+
+//! Per-thread argument of worker()
+typedef struct worker_arg_s
+{
+	thread_pool_t *pool;  // Pool the worker belongs to
+	int id;               // Worker index passed to func
+} worker_arg_t;
+
+struct thread_pool_s
+{
+	int num_threads;      // Number of workers, including the thread calling pool_run()
+	job_func_t func;      // Function to call for each job of the current batch
+	void *ctx;            // Context passed to func
+	int num_jobs;         // Total number of jobs in the current batch
+	int next_job;         // Index of next job to hand out
+	int batch;            // Incremented by pool_run() to wake the workers
+	int busy;             // Spawned workers that have not finished the current batch
+	int quit;             // Set by pool_destroy() to end the workers
+	worker_arg_t *args;   // Worker arguments (args[0] is the calling thread)
+#ifdef WIN32
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE start;   // Signalled when a batch starts or the pool is destroyed
+	CONDITION_VARIABLE done;    // Signalled when the last spawned worker finishes a batch
+	HANDLE *threads;
+#else
+	pthread_mutex_t lock;
+	pthread_cond_t start;       // Signalled when a batch starts or the pool is destroyed
+	pthread_cond_t done;        // Signalled when the last spawned worker finishes a batch
+	pthread_t *threads;
+#endif
+};
+
+#ifdef WIN32
+#define POOL_LOCK(p)          EnterCriticalSection(&(p)->lock)
+#define POOL_UNLOCK(p)        LeaveCriticalSection(&(p)->lock)
+#define POOL_WAIT(p, cv)      SleepConditionVariableCS(&(p)->cv, &(p)->lock, INFINITE)
+#define POOL_SIGNAL(p, cv)    WakeConditionVariable(&(p)->cv)
+#define POOL_BROADCAST(p, cv) WakeAllConditionVariable(&(p)->cv)
+#else
+#define POOL_LOCK(p)          pthread_mutex_lock(&(p)->lock)
+#define POOL_UNLOCK(p)        pthread_mutex_unlock(&(p)->lock)
+#define POOL_WAIT(p, cv)      pthread_cond_wait(&(p)->cv, &(p)->lock)
+#define POOL_SIGNAL(p, cv)    pthread_cond_signal(&(p)->cv)
+#define POOL_BROADCAST(p, cv) pthread_cond_broadcast(&(p)->cv)
+#endif
+
+
+//! Hand out the next job index, or -1 if all jobs have been taken
+/*! \param pool      Thread pool
+	\return          Job index */
+static int next_job(thread_pool_t *pool)
+{
+	int idx;
+
+	POOL_LOCK(pool);
+	idx = (pool->next_job < pool->num_jobs) ? pool->next_job++ : -1;
+	POOL_UNLOCK(pool);
+	return (idx);
+}
+
+
+//! Keep pulling jobs of the current batch until none are left
+/*! \param w         Worker argument */
+static void run_batch(worker_arg_t *w)
+{
+	thread_pool_t *pool = w->pool;
+	int idx;
+
+	while ((idx = next_job(pool)) >= 0)
+		pool->func(pool->ctx, w->id, idx);
+}
+
+
+//! Worker thread body: run each batch as it starts, until the pool is destroyed
+/*! \param arg       Worker argument (worker_arg_t) */
+#ifdef WIN32
+static DWORD WINAPI worker(LPVOID arg)
+#else
+static void *worker(void *arg)
+#endif
+{
+	worker_arg_t *w = (worker_arg_t *)arg;
+	thread_pool_t *pool = w->pool;
+	int seen = 0;
+
+	POOL_LOCK(pool);
+	for (;;)
+	{
+		while ((pool->batch == seen) && !pool->quit)
+			POOL_WAIT(pool, start);
+		if (pool->quit)
+			break;
+		seen = pool->batch;
+		POOL_UNLOCK(pool);
+
+		run_batch(w);
+
+		POOL_LOCK(pool);
+		if (--pool->busy == 0)
+			POOL_SIGNAL(pool, done);
+	}
+	POOL_UNLOCK(pool);
+	return (0);
+}
+
+
+//! Create a pool of worker threads
+/*! The calling thread acts as worker 0 in pool_run(), so num_threads - 1 threads are
+    started here and kept waiting for work until pool_destroy().
+	\param num_threads Number of threads to use (values below 1 are treated as 1)
+	\return            Thread pool */
+thread_pool_t *pool_create(int num_threads)
+{
+	thread_pool_t *pool;
+	int i;
+
+	if (num_threads < 1)
+		num_threads = 1;
+	pool = (thread_pool_t *)calloc(1, sizeof(thread_pool_t));
+	if (pool != NULL)
+		pool->args = (worker_arg_t *)malloc(sizeof(worker_arg_t) * num_threads);
+	if ((pool == NULL) || (pool->args == NULL))
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
+	pool->num_threads = num_threads;
+	for (i = 0; i < num_threads; ++i)
+	{
+		pool->args[i].pool = pool;
+		pool->args[i].id = i;
+	}
+	if (num_threads == 1)
+		return (pool);
+
+#ifdef WIN32
+	InitializeCriticalSection(&pool->lock);
+	InitializeConditionVariable(&pool->start);
+	InitializeConditionVariable(&pool->done);
+	pool->threads = (HANDLE *)malloc(sizeof(HANDLE) * (num_threads - 1));
+	for (i = 1; i < num_threads; ++i)
+		if ((pool->threads[i-1] = CreateThread(NULL, 0, worker, &pool->args[i], 0, NULL)) == NULL)
+			Err("Unable to create worker thread\n");
+#else
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * (num_threads - 1));
+	for (i = 1; i < num_threads; ++i)
+		if (pthread_create(&pool->threads[i-1], NULL, worker, &pool->args[i]))
+			Err("Unable to create worker thread\n");
+#endif
+	return (pool);
+}
+
+
+//! Run func(ctx, worker, i) for i = 0 .. num_jobs-1 on the pool's threads
+/*! Jobs are handed out in increasing index order.  The calling thread acts as worker 0,
+    and the function returns once every job has completed.  A worker runs one job at a
+	time, so func may keep per-worker state indexed by the worker argument.  With a
+	single thread the jobs are simply run in order on the calling thread.
+    \param pool        Thread pool
+	\param num_jobs    Number of jobs
+	\param func        Function to run for each job
+	\param ctx         Context pointer passed to func */
+void pool_run(thread_pool_t *pool, int num_jobs, job_func_t func, void *ctx)
+{
+	int i;
+
+	if (pool->num_threads == 1)
+	{
+		for (i = 0; i < num_jobs; ++i)
+			func(ctx, 0, i);
+		return;
+	}
+
+	POOL_LOCK(pool);
+	pool->func = func;
+	pool->ctx = ctx;
+	pool->num_jobs = num_jobs;
+	pool->next_job = 0;
+	pool->busy = pool->num_threads - 1;
+	pool->batch++;
+	POOL_BROADCAST(pool, start);
+	POOL_UNLOCK(pool);
+
+	run_batch(&pool->args[0]);
+
+	POOL_LOCK(pool);
+	while (pool->busy > 0)
+		POOL_WAIT(pool, done);
+	POOL_UNLOCK(pool);
+}
+
+
+//! Stop the worker threads and free the pool
+/*! \param pool      Thread pool (may be NULL) */
+void pool_destroy(thread_pool_t *pool)
+{
+	int i;
+
+	if (pool == NULL)
+		return;
+	if (pool->num_threads > 1)
+	{
+		POOL_LOCK(pool);
+		pool->quit = 1;
+		POOL_BROADCAST(pool, start);
+		POOL_UNLOCK(pool);
+		for (i = 0; i < pool->num_threads - 1; ++i)
+		{
+#ifdef WIN32
+			WaitForSingleObject(pool->threads[i], INFINITE);
+			CloseHandle(pool->threads[i]);
+#else
+			pthread_join(pool->threads[i], NULL);
+#endif
+		}
+#ifdef WIN32
+		DeleteCriticalSection(&pool->lock);
+#else
+		pthread_cond_destroy(&pool->start);
+		pthread_cond_destroy(&pool->done);
+		pthread_mutex_destroy(&pool->lock);
+#endif
+		free(pool->threads);
+	}
+	free(pool->args);
+	free(pool);
+}
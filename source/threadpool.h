@@ -0,0 +1,24 @@
+/***************************************************************************
+*    Contributed to VESA for inclusion and use in its VESA Display Stream
+*    Compression reference model.  This file extends the Broadcom
+*    contribution and is distributed under the same terms and conditions
+*    as the rest of the model.
+***************************************************************************/
+
+/*! \file threadpool.h
+ *    Simple worker pool for running independent jobs (slices) in parallel */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/// Job function: worker is the index (0 .. num_threads-1) of the thread running the job
+typedef void (*job_func_t)(void *ctx, int worker, int job_idx);
+
+/// Opaque pool of worker threads, kept alive between batches of jobs
+typedef struct thread_pool_s thread_pool_t;
+
+thread_pool_t *pool_create(int num_threads);
+void pool_run(thread_pool_t *pool, int num_jobs, job_func_t func, void *ctx);
+void pool_destroy(thread_pool_t *pool);
+
+#endif
@@ -49,58 +49,202 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
 
 #include "vdo.h"
 #include "utl.h"
 #include "logging.h"
 
 
-//! Allocate the memory for pixel data
-/*! \param w       Picture width
-    \param h       Picture height
-    \return        Pointer to 2D pixel buffer */
-void *palloc(int w, int h)
+#define PLANE_ALIGN   64    // Byte alignment of planes and of each row within a plane
+#define PPOOL_MAX     16    // Maximum number of pictures kept for reuse
+
+// Pictures released by pdestroy() while the pool is enabled, reused by pcreate() for the same plane geometry.
+// The pool is not thread-safe; pictures must be created and destroyed by one thread.
+static pic_t *g_ppool[PPOOL_MAX];
+static int g_ppool_size = 0;
+static int g_ppool_max = 0;
+
+
+//! Allocate zeroed memory aligned to PLANE_ALIGN bytes
+/*! \param size    Number of bytes
+    \return        Pointer to memory (free with aligned_free()) */
+static void *aligned_calloc(size_t size)
 {
-	int **p;
-	int   i;
+	unsigned char *raw, *p;
 
-	p = (int **) calloc(h, sizeof(short *));
-	if (p == NULL)
+	raw = calloc(size + PLANE_ALIGN + sizeof(void *), 1);
+	if (raw == NULL)
 	{
 		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
 		exit(1);
 	}
-	else
-		for (i = 0; i < h; i++)
+	p = raw + sizeof(void *);
+	p += (PLANE_ALIGN - ((size_t)p % PLANE_ALIGN)) % PLANE_ALIGN;
+	((void **)p)[-1] = raw;   // Remember the start of the block for aligned_free()
+	return p;
+}
+
+
+//! Free memory from aligned_calloc()
+/*! \param p       Pointer to memory (may be NULL) */
+static void aligned_free(void *p)
+{
+	if (p != NULL)
+		free(((void **)p)[-1]);
+}
+
+
+//! Row stride of a plane
+/*! \param w       Plane width
+	\param sample_bytes Bytes per sample
+    \return        Samples from one row to the next (rows are PLANE_ALIGN aligned) */
+static int plane_stride(int w, int sample_bytes)
+{
+	return ((int)(((size_t)w * sample_bytes + PLANE_ALIGN - 1) / PLANE_ALIGN * PLANE_ALIGN / sample_bytes));
+}
+
+
+//! Allocate one plane as a single contiguous block
+/*! \param w       Plane width
+    \param h       Plane height
+	\param sample_bytes Bytes per sample
+	\param plane   Returns the plane storage
+	\param stride  Returns the distance between rows in samples
+    \return        Row pointers into the plane for int samples, or NULL for 16-bit samples */
+static int **plane_alloc(int w, int h, int sample_bytes, void **plane, int *stride)
+{
+	int **p = NULL;
+	int   i;
+
+	*stride = plane_stride(w, sample_bytes);
+	*plane = aligned_calloc((size_t)*stride * h * sample_bytes);
+	if (sample_bytes == sizeof(int))
+	{
+		p = (int **) calloc(h, sizeof(int *));
+		if (p == NULL)
 		{
-			p[i] = calloc(w, sizeof(int));
-			if (p[i] == NULL)
-			{
-				fprintf(stderr, "ERROR: Failed to allocate memory.\n");
-				exit(1);
-			}
+			fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+			exit(1);
 		}
-		return p;
+		for (i = 0; i < h; i++)
+			p[i] = (int *)*plane + (size_t)i * *stride;
+	}
+	return p;
 }
 
 
-//! Create a picture object
+//! Allocate the memory for pixel data
+/*! The samples are one contiguous block.
+    \param w       Picture width
+    \param h       Picture height (must be > 0)
+    \return        Pointer to 2D pixel buffer (free with pfree()) */
+void *palloc(int w, int h)
+{
+	void *plane;
+	int   stride;
+	int **p;
+
+	p = plane_alloc(w, h, sizeof(int), &plane, &stride);
+	return p;
+}
+
+
+//! Free pixel data from palloc()
+/*! \param p       Pointer to 2D pixel buffer */
+void pfree(void *p)
+{
+	int **rows = (int **)p;
+
+	if (rows == NULL)
+		return;
+	aligned_free(rows[0]);
+	free(rows);
+}
+
+
+//! Keep pictures released by pdestroy() for reuse by pcreate()/pcreate16()
+/*! Useful when many pictures of the same size are processed in turn, so that the frame memory is only
+    allocated (and paged in) once.
+	\param max_pics Maximum number of pictures to keep (0 disables the pool) */
+void ppool_init(int max_pics)
+{
+	ppool_free();
+	g_ppool_max = CLAMP(max_pics, 0, PPOOL_MAX);
+}
+
+
+//! Free all pictures kept for reuse and disable the pool
+void ppool_free(void)
+{
+	g_ppool_max = 0;
+	while (g_ppool_size > 0)
+		pdestroy(g_ppool[--g_ppool_size]);
+}
+
+
+//! Create a picture object with a given sample storage size
 /*! \param format  indicates field or frame
     \param color   color space
 	\param chroma  Chroma subsampling
 	\param w       Picture width
 	\param h       Picture height
+	\param sample_bytes Bytes per sample (sizeof(int), or 2)
     \return        Pointer to picture (pic_t) object */
-pic_t *pcreate(int format, int color, int chroma, int w, int h)
+static pic_t *pcreate_planes(int format, int color, int chroma, int w, int h, int sample_bytes)
 {
 	pic_t *p;    
+	int    cw = w, ch = h;   // Chroma plane size
+	int  **rows[3];
+	int    i, j, k;
 
-	p = malloc(sizeof(pic_t));
+	if (color != RGB && chroma == YUV_420)
+	{
+		cw = w / 2;
+		ch = h / 2;
+	}
+	else if (color != RGB && chroma == YUV_422)
+		cw = w / 2;
 
-	if (p == NULL)
+	// Reuse a pooled picture with the same plane sizes
+	for (j = g_ppool_size - 1; j >= 0; j--)
 	{
-		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
-		exit(1);
+		p = g_ppool[j];
+		for (i = 0; i < 3; i++)
+		{
+			if ((p->sample_bytes != sample_bytes) || (p->stride[i] != plane_stride(i ? cw : w, sample_bytes)) || (p->plane_h[i] != (i ? ch : h)))
+				break;
+		}
+		if (i == 3)
+			break;
+	}
+	if (j >= 0)
+	{
+		for (k = j; k < g_ppool_size - 1; k++)
+			g_ppool[k] = g_ppool[k+1];
+		g_ppool_size--;
+		for (i = 0; i < 3; i++)
+		{
+			memset(p->plane[i], 0, (size_t)p->stride[i] * p->plane_h[i] * sample_bytes);
+			rows[i] = (i==0) ? p->data.yuv.y : (i==1) ? p->data.yuv.u : p->data.yuv.v;   // Same slots as r/g/b
+		}
+	}
+	else
+	{
+		p = malloc(sizeof(pic_t));
+
+		if (p == NULL)
+		{
+			fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+			exit(1);
+		}
+		for (i = 0; i < 3; i++)
+		{
+			rows[i] = plane_alloc(i ? cw : w, i ? ch : h, sample_bytes, &p->plane[i], &p->stride[i]);
+			p->plane_h[i] = i ? ch : h;
+		}
 	}
 
 	p->format = format;
@@ -109,34 +253,20 @@ pic_t *pcreate(int format, int color, int chroma, int w, int h)
 
 	p->w = w;
 	p->h = h;
+	p->sample_bytes = sample_bytes;
 
 	if (color == RGB)
 	{
-		p->data.rgb.r = (int **) palloc(w, h);
-		p->data.rgb.g = (int **) palloc(w, h);
-		p->data.rgb.b = (int **) palloc(w, h);
+		p->data.rgb.r = rows[0];
+		p->data.rgb.g = rows[1];
+		p->data.rgb.b = rows[2];
 		//p->data.rgb.a = (int **) palloc(w, h);
 	}
-	else if (chroma == YUV_420)
-	{
-		p->data.yuv.y = (int **) palloc(w, h);
-		p->data.yuv.u = (int **) palloc(w / 2, h / 2);
-		p->data.yuv.v = (int **) palloc(w / 2, h / 2);
-		//p->data.yuv.a = (int **) palloc(w, h);
-	}
-	else if (chroma == YUV_422)
-	{
-
-		p->data.yuv.y = (int **) palloc(w, h);
-		p->data.yuv.u = (int **) palloc(w / 2, h);
-		p->data.yuv.v = (int **) palloc(w / 2, h);
-		//p->data.yuv.a = (int **) palloc(w, h);
-	}
 	else
 	{
-		p->data.yuv.y = (int **) palloc(w, h);
-		p->data.yuv.u = (int **) palloc(w, h);
-		p->data.yuv.v = (int **) palloc(w, h);
+		p->data.yuv.y = rows[0];
+		p->data.yuv.u = rows[1];
+		p->data.yuv.v = rows[2];
 		//p->data.yuv.a = (int **) palloc(w, h);
 	}
 
@@ -153,6 +283,34 @@ pic_t *pcreate(int format, int color, int chroma, int w, int h)
 }
 
 
+//! Create a picture object
+/*! \param format  indicates field or frame
+    \param color   color space
+	\param chroma  Chroma subsampling
+	\param w       Picture width
+	\param h       Picture height
+    \return        Pointer to picture (pic_t) object */
+pic_t *pcreate(int format, int color, int chroma, int w, int h)
+{
+	return (pcreate_planes(format, color, chroma, w, h, sizeof(int)));
+}
+
+
+//! Create a picture object with 16-bit samples
+/*! The row pointers in data are NULL: the samples are accessed with PIC_ROW16(), or as int rows
+    with prow_get()/prow_target()/prow_put(), which every picture helper uses.
+    \param format  indicates field or frame
+    \param color   color space
+	\param chroma  Chroma subsampling
+	\param w       Picture width
+	\param h       Picture height
+    \return        Pointer to picture (pic_t) object */
+pic_t *pcreate16(int format, int color, int chroma, int w, int h)
+{
+	return (pcreate_planes(format, color, chroma, w, h, sizeof(unsigned short)));
+}
+
+
 //! Destroy a picture object
 /*! \param p        Pointer to picture (pic_t) object
 	\return         NULL pointer */
@@ -160,94 +318,611 @@ void *pdestroy(pic_t *p)
 {
 	int i;
 
+	if (g_ppool_size < g_ppool_max)
+	{
+		g_ppool[g_ppool_size++] = p;   // Keep for reuse
+		return(NULL);
+	}
+	for (i = 0; i < 3; i++)
+		aligned_free(p->plane[i]);
 	if (p->color == RGB)
 	{
-		for (i = 0; i < p->h; i++)
-		{
-			free(p->data.rgb.r[i]);
-			free(p->data.rgb.g[i]);
-			free(p->data.rgb.b[i]);
-			//free(p->data.rgb.a[i]);
-		}
 		free(p->data.rgb.r);
 		free(p->data.rgb.g);
 		free(p->data.rgb.b);
 		//free(p->data.rgb.a);
 	}
-	else if (p->chroma == YUV_420)
+	else
+	{
+		free(p->data.yuv.y);
+		free(p->data.yuv.u);
+		free(p->data.yuv.v);
+		//free(p->data.yuv.a);
+	}
+	free(p);
+	return(NULL);
+}
+
+
+//! Row pointer slot of one plane (0: r/y, 1: g/u, 2: b/v, 3: alpha)
+/*! \param p       Picture
+	\param c       Plane index
+	\return        Pointer to the row pointer array of the plane */
+static int ***plane_slot(pic_t *p, int c)
+{
+	return ((c==0) ? &p->data.yuv.y : (c==1) ? &p->data.yuv.u : (c==2) ? &p->data.yuv.v : &p->data.yuv.a);   // Same slots as r/g/b/a
+}
+
+
+//! Row pointers of one plane (0: r/y, 1: g/u, 2: b/v)
+/*! Only valid for pictures with int samples.
+	\param p       Picture
+	\param c       Plane index
+	\return        Row pointer array of the plane */
+static int **plane_rows(pic_t *p, int c)
+{
+	return (*plane_slot(p, c));
+}
+
+
+//! Number of samples in each row of a plane
+/*! \param p       Picture
+	\param c       Plane index
+	\return        Plane width */
+static int plane_width(pic_t *p, int c)
+{
+	if ((c == 1 || c == 2) && (p->color != RGB) && ((p->chroma == YUV_422) || (p->chroma == YUV_420)))
+		return (p->w / 2);
+	return (p->w);
+}
+
+
+//! Row of a plane with 16-bit samples
+/*! \param p       Picture
+	\param c       Plane index (16-bit pictures have no alpha plane)
+	\param y       Row
+	\return        Samples of the row */
+static unsigned short *plane_row16(pic_t *p, int c, int y)
+{
+	if (c > 2)
+	{
+		fprintf(stderr, "ERROR: Pictures with 16-bit samples have no alpha plane\n");
+		exit(1);
+	}
+	return (PIC_ROW16(p, c, y));
+}
+
+
+//! Get one row of a plane as int samples
+/*! Works for both sample sizes: pictures with int samples return their own row (which may be
+    modified in place), 16-bit samples are widened into tmp.
+	\param p       Picture
+	\param c       Plane index (0: r/y, 1: g/u, 2: b/v, 3: alpha of an int picture)
+	\param y       Row
+	\param tmp     Buffer for one row of the plane
+	\return        Samples of the row */
+int *prow_get(pic_t *p, int c, int y, int *tmp)
+{
+	const unsigned short *s;
+	int n, j;
+
+	if (p->sample_bytes == sizeof(int))
+		return (plane_rows(p, c)[y]);
+	s = plane_row16(p, c, y);
+	n = plane_width(p, c);
+	for (j = 0; j < n; j++)
+		tmp[j] = s[j];
+	return (tmp);
+}
+
+
+//! Get a row to build int samples of one plane row in (store them with prow_put())
+/*! \param p       Picture
+	\param c       Plane index
+	\param y       Row
+	\param tmp     Buffer for one row of the plane
+	\return        The picture's own row for int samples, or tmp */
+int *prow_target(pic_t *p, int c, int y, int *tmp)
+{
+	if (p->sample_bytes == sizeof(int))
+		return (plane_rows(p, c)[y]);
+	return (tmp);
+}
+
+
+//! Store int samples into one row of a plane
+/*! Nothing is copied if row is the picture's own row (from prow_get() or prow_target()).
+	\param p       Picture
+	\param c       Plane index
+	\param y       Row
+	\param row     Samples (plane width) */
+void prow_put(pic_t *p, int c, int y, const int *row)
+{
+	unsigned short *d;
+	int *own, n, j;
+
+	n = plane_width(p, c);
+	if (p->sample_bytes == sizeof(int))
+	{
+		own = plane_rows(p, c)[y];
+		if (own != row)
+			memcpy(own, row, n * sizeof(int));
+		return;
+	}
+	d = plane_row16(p, c, y);
+	for (j = 0; j < n; j++)
+		d[j] = (unsigned short)row[j];
+}
+
+
+//! Exchange two planes of the same size (such as R and B) without moving any samples
+/*! \param p       Picture
+	\param c0      First plane index
+	\param c1      Second plane index */
+void pswap_planes(pic_t *p, int c0, int c1)
+{
+	int  **rows;
+	void  *plane;
+
+	if ((c0 > 2) || (c1 > 2) || (plane_width(p, c0) != plane_width(p, c1)) || (p->plane_h[c0] != p->plane_h[c1]))
 	{
-		for (i = 0; i < p->h; i++)
+		fprintf(stderr, "ERROR: pswap_planes() expects two color planes of the same size\n");
+		exit(1);
+	}
+	rows = *plane_slot(p, c0);
+	*plane_slot(p, c0) = *plane_slot(p, c1);
+	*plane_slot(p, c1) = rows;
+	plane = p->plane[c0];
+	p->plane[c0] = p->plane[c1];
+	p->plane[c1] = plane;   // Same size, so the strides match
+}
+
+
+// Fixed-point precision of the chroma resampling filter taps
+#define FIR_BITS      8
+
+// Chroma resampling filters. 4:2:2 chroma is co-sited with the even luma samples.
+// 4:2:2 to 4:4:4: phase 0 copies the co-sited sample, phase 1 interpolates halfway to the next one.
+static const fir_t fir_422_444 = {4, 2, {0.0f, 1.0f, 0.0f, 0.0f,
+                                         -0.0625f, 0.5625f, 0.5625f, -0.0625f}};
+// 4:4:4 to 4:2:2: low-pass filter centered on the even luma samples
+static const fir_t fir_444_422 = {7, 1, {-0.03125f, 0.0f, 0.28125f, 0.5f, 0.28125f, 0.0f, -0.03125f}};
+
+// Color space conversion out = ((m * (in - in_off)) >> shift) + out_off, clamped to [0, maxval]
+// Planes are ordered R, G, B and Y, Cb, Cr.
+typedef struct csc_s {
+	int m[3][3];
+	int shift;
+	int in_off[3];
+	int out_off[3];
+	int maxval;
+	int wide;          // Accumulate in 64 bits (bit depths above 13)
+} csc_t;
+
+
+//! Set up the integer matrix for an RGB <-> YCbCr conversion
+/*! RGB is full range; YCbCr is video range (Y 16-235, Cb/Cr 16-240 at 8 bits).
+    \param csc     Conversion to set up
+	\param color   YCbCr color space (YUV_HD: BT.709, YUV_SD: BT.601)
+	\param to_yuv  1 for RGB to YCbCr, 0 for YCbCr to RGB
+	\param bits    Bit depth of the samples */
+static void csc_setup(csc_t *csc, int color, int to_yuv, int bits)
+{
+	double kr = (color == YUV_SD) ? 0.299 : 0.2126;
+	double kb = (color == YUV_SD) ? 0.114 : 0.0722;
+	double kg = 1.0 - kr - kb;
+	double maxval = (double)((1 << bits) - 1);
+	double ys = 219.0 * (1 << bits) / 256.0 / maxval;
+	double cs = 224.0 * (1 << bits) / 256.0 / maxval;
+	double f[3][3], inv[3][3], det;
+	int yoff = (16 << bits) >> 8, coff = (128 << bits) >> 8;
+	int i, k;
+
+	f[0][0] = ys * kr;                     f[0][1] = ys * kg;                     f[0][2] = ys * kb;
+	f[1][0] = -cs * kr / (2.0 * (1.0-kb)); f[1][1] = -cs * kg / (2.0 * (1.0-kb)); f[1][2] = cs * 0.5;
+	f[2][0] = cs * 0.5;                    f[2][1] = -cs * kg / (2.0 * (1.0-kr)); f[2][2] = -cs * kb / (2.0 * (1.0-kr));
+
+	if (!to_yuv)
+	{
+		det = f[0][0] * (f[1][1]*f[2][2] - f[1][2]*f[2][1])
+		    - f[0][1] * (f[1][0]*f[2][2] - f[1][2]*f[2][0])
+		    + f[0][2] * (f[1][0]*f[2][1] - f[1][1]*f[2][0]);
+		for (i = 0; i < 3; i++)
+			for (k = 0; k < 3; k++)
+				inv[k][i] = (f[(i+1)%3][(k+1)%3] * f[(i+2)%3][(k+2)%3] - f[(i+1)%3][(k+2)%3] * f[(i+2)%3][(k+1)%3]) / det;
+		memcpy(f, inv, sizeof(f));
+	}
+
+	// Every row sums to less than 4 in magnitude, so 32-bit products need bits + 2 bits of
+	// headroom above the 16 fractional bits; deeper samples are accumulated in 64 bits
+	csc->shift = 16;
+	csc->wide = (bits + 2 + csc->shift > 31);
+	for (i = 0; i < 3; i++)
+	{
+		for (k = 0; k < 3; k++)
+			csc->m[i][k] = (int)floor(f[i][k] * (1 << csc->shift) + 0.5);
+		csc->in_off[i] = to_yuv ? 0 : (i ? coff : yoff);
+		csc->out_off[i] = to_yuv ? (i ? coff : yoff) : 0;
+	}
+	csc->maxval = (1 << bits) - 1;
+}
+
+
+//! Convert one row between RGB and YCbCr
+/*! \param csc     Conversion (see csc_setup())
+	\param in      Input rows of the three planes
+	\param out     Output rows of the three planes (may be the input rows)
+	\param n       Number of samples */
+static void csc_row(const csc_t *csc, int *const in[3], int *const out[3], int n)
+{
+	int j = 0, c, acc;
+	int a[3];
+
+#if defined(__AVX2__)
+	if (!csc->wide)
+	{
+		__m256i x[3], v;
+		__m128i sh = _mm_cvtsi32_si128(csc->shift);
+		__m256i rnd = _mm256_set1_epi32(1 << (csc->shift - 1));
+		__m256i lo = _mm256_setzero_si256(), hi = _mm256_set1_epi32(csc->maxval);
+
+		for (; j + 8 <= n; j += 8)
 		{
-			free(p->data.yuv.y[i]);
-			//free(p->data.yuv.a[i]);
+			for (c = 0; c < 3; c++)
+				x[c] = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(in[c] + j)), _mm256_set1_epi32(csc->in_off[c]));
+			for (c = 0; c < 3; c++)
+			{
+				v = _mm256_add_epi32(_mm256_mullo_epi32(x[0], _mm256_set1_epi32(csc->m[c][0])),
+				                     _mm256_mullo_epi32(x[1], _mm256_set1_epi32(csc->m[c][1])));
+				v = _mm256_add_epi32(v, _mm256_mullo_epi32(x[2], _mm256_set1_epi32(csc->m[c][2])));
+				v = _mm256_sra_epi32(_mm256_add_epi32(v, rnd), sh);
+				v = _mm256_add_epi32(v, _mm256_set1_epi32(csc->out_off[c]));
+				_mm256_storeu_si256((__m256i *)(out[c] + j), _mm256_min_epi32(_mm256_max_epi32(v, lo), hi));
+			}
 		}
+	}
+#elif defined(__SSE4_1__)
+	if (!csc->wide)
+	{
+		__m128i x[3], v;
+		__m128i sh = _mm_cvtsi32_si128(csc->shift);
+		__m128i rnd = _mm_set1_epi32(1 << (csc->shift - 1));
+		__m128i lo = _mm_setzero_si128(), hi = _mm_set1_epi32(csc->maxval);
 
-		for (i = 0; i < p->h / 2; i++)
+		for (; j + 4 <= n; j += 4)
 		{
-			free(p->data.yuv.u[i]);
-			free(p->data.yuv.v[i]);
+			for (c = 0; c < 3; c++)
+				x[c] = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(in[c] + j)), _mm_set1_epi32(csc->in_off[c]));
+			for (c = 0; c < 3; c++)
+			{
+				v = _mm_add_epi32(_mm_mullo_epi32(x[0], _mm_set1_epi32(csc->m[c][0])),
+				                  _mm_mullo_epi32(x[1], _mm_set1_epi32(csc->m[c][1])));
+				v = _mm_add_epi32(v, _mm_mullo_epi32(x[2], _mm_set1_epi32(csc->m[c][2])));
+				v = _mm_sra_epi32(_mm_add_epi32(v, rnd), sh);
+				v = _mm_add_epi32(v, _mm_set1_epi32(csc->out_off[c]));
+				_mm_storeu_si128((__m128i *)(out[c] + j), _mm_min_epi32(_mm_max_epi32(v, lo), hi));
+			}
 		}
-		free(p->data.yuv.y);
-		free(p->data.yuv.u);
-		free(p->data.yuv.v);
-		//free(p->data.yuv.a);
 	}
-	else
+#endif
+	for (; j < n; j++)
 	{
-		for (i = 0; i < p->h; i++)
+		for (c = 0; c < 3; c++)
+			a[c] = in[c][j] - csc->in_off[c];
+		for (c = 0; c < 3; c++)
 		{
-			free(p->data.yuv.y[i]);
-			free(p->data.yuv.u[i]);
-			free(p->data.yuv.v[i]);
-			//free(p->data.yuv.a[i]);
+			if (csc->wide)
+				acc = (int)(((long long)csc->m[c][0] * a[0] + (long long)csc->m[c][1] * a[1] + (long long)csc->m[c][2] * a[2] + (1 << (csc->shift - 1))) >> csc->shift) + csc->out_off[c];
+			else
+				acc = ((csc->m[c][0] * a[0] + csc->m[c][1] * a[1] + csc->m[c][2] * a[2] + (1 << (csc->shift - 1))) >> csc->shift) + csc->out_off[c];
+			out[c][j] = CLAMP(acc, 0, csc->maxval);
 		}
-		free(p->data.yuv.y);
-		free(p->data.yuv.u);
-		free(p->data.yuv.v);
-		//free(p->data.yuv.a);
 	}
-	free(p);
-	return(NULL);
 }
 
 
-//! Convert RGB to YCbCr (unsupported)
-/*! \param ip      Input picture (pic_t)
+//! Convert the taps of a filter to FIR_BITS fixed point
+/*! \param f       Filter
+	\param coeff   Fixed-point taps (tap * sub entries) */
+static void fir_setup(const fir_t *f, int *coeff)
+{
+	int i;
+
+	for (i = 0; i < f->tap * f->sub; i++)
+		coeff[i] = (int)floor(f->coeff[i] * (1 << FIR_BITS) + 0.5);
+}
+
+
+//! Copy a row with its end samples replicated on both sides
+/*! \param in      Input row
+	\param n       Number of input samples (> 0)
+	\param before  Samples to add on the left
+	\param after   Samples to add on the right
+	\param pad     Output row (n + before + after samples) */
+static void pad_row(const int *in, int n, int before, int after, int *pad)
+{
+	int k;
+
+	for (k = 0; k < before; k++)
+		pad[k] = in[0];
+	memcpy(pad + before, in, n * sizeof(int));
+	for (k = 0; k < after; k++)
+		pad[before + n + k] = in[n-1];
+}
+
+
+//! Apply one phase of a filter along a row
+/*! out[k] = in[k] * coeff[0] + ... + in[k+tap-1] * coeff[tap-1], rounded and clamped to [0, maxval]
+    \param in      Padded input row (n + tap - 1 samples)
+	\param n       Number of output samples
+	\param coeff   FIR_BITS fixed-point taps
+	\param tap     Number of taps
+	\param maxval  Maximum output value
+	\param out     Output row */
+static void fir_row(const int *in, int n, const int *coeff, int tap, int maxval, int *out)
+{
+	int k = 0, t, acc;
+
+#if defined(__AVX2__)
+	{
+		__m256i v, lo = _mm256_setzero_si256(), hi = _mm256_set1_epi32(maxval);
+		__m256i rnd = _mm256_set1_epi32(1 << (FIR_BITS - 1));
+
+		for (; k + 8 <= n; k += 8)
+		{
+			v = rnd;
+			for (t = 0; t < tap; t++)
+				v = _mm256_add_epi32(v, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)(in + k + t)), _mm256_set1_epi32(coeff[t])));
+			v = _mm256_srai_epi32(v, FIR_BITS);
+			_mm256_storeu_si256((__m256i *)(out + k), _mm256_min_epi32(_mm256_max_epi32(v, lo), hi));
+		}
+	}
+#elif defined(__SSE4_1__)
+	{
+		__m128i v, lo = _mm_setzero_si128(), hi = _mm_set1_epi32(maxval);
+		__m128i rnd = _mm_set1_epi32(1 << (FIR_BITS - 1));
+
+		for (; k + 4 <= n; k += 4)
+		{
+			v = rnd;
+			for (t = 0; t < tap; t++)
+				v = _mm_add_epi32(v, _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(in + k + t)), _mm_set1_epi32(coeff[t])));
+			v = _mm_srai_epi32(v, FIR_BITS);
+			_mm_storeu_si128((__m128i *)(out + k), _mm_min_epi32(_mm_max_epi32(v, lo), hi));
+		}
+	}
+#endif
+	for (; k < n; k++)
+	{
+		acc = 1 << (FIR_BITS - 1);
+		for (t = 0; t < tap; t++)
+			acc += in[k + t] * coeff[t];
+		acc >>= FIR_BITS;
+		out[k] = CLAMP(acc, 0, maxval);
+	}
+}
+
+
+//! Upsample one 4:2:2 chroma row to 4:4:4 with fir_422_444
+/*! \param in      Input chroma row
+	\param n_in    Number of input samples
+	\param n_out   Number of output samples
+	\param coeff   Fixed-point taps of fir_422_444
+	\param maxval  Maximum sample value
+	\param scratch Work memory (2 * n_out + 2 * tap samples)
+	\param out     Output row */
+static void chroma_up_row(const int *in, int n_in, int n_out, const int *coeff, int maxval, int *scratch, int *out)
+{
+	int tap = fir_422_444.tap, sub = fir_422_444.sub;
+	int before = (tap - 1) / 2;
+	int n = (n_out + sub - 1) / sub;      // Outputs per phase
+	int *pad = scratch, *tmp = scratch + MAX(n, n_in) + tap;
+	int k, p;
+
+	if (n_in <= 0)
+		return;
+	pad_row(in, n_in, before, tap - 1 - before + MAX(n - n_in, 0), pad);
+	for (p = 0; p < sub; p++)
+	{
+		fir_row(pad, n, coeff + p * tap, tap, maxval, tmp);
+		for (k = 0; k * sub + p < n_out; k++)
+			out[k * sub + p] = tmp[k];
+	}
+}
+
+
+//! Downsample one 4:4:4 chroma row to 4:2:2 with fir_444_422
+/*! \param in      Input chroma row
+	\param n_in    Number of input samples
+	\param n_out   Number of output samples
+	\param coeff   Fixed-point taps of fir_444_422
+	\param maxval  Maximum sample value
+	\param scratch Work memory (2 * n_in + 2 * tap samples)
+	\param out     Output row */
+static void chroma_down_row(const int *in, int n_in, int n_out, const int *coeff, int maxval, int *scratch, int *out)
+{
+	int tap = fir_444_422.tap;
+	int before = (tap - 1) / 2;
+	int *pad = scratch, *tmp = scratch + n_in + tap;
+	int k;
+
+	if (n_in <= 0)
+		return;
+	// Filter at the full rate so the kernel reads contiguous samples, then keep the even positions
+	pad_row(in, n_in, before, tap - 1 - before, pad);
+	fir_row(pad, n_in, coeff, tap, maxval, tmp);
+	for (k = 0; k < n_out; k++)
+		out[k] = tmp[2 * k];
+}
+
+
+//! Check the geometry of a conversion between two pictures
+/*! \param ip      Input picture
+	\param op      Output picture
+	\param name    Name of the conversion for error messages */
+static void check_conversion(pic_t *ip, pic_t *op, const char *name)
+{
+	if ((ip->w != op->w) || (ip->h != op->h))
+	{
+		fprintf(stderr, "ERROR: %s() expects input and output raster sizes to match\n", name);
+		exit(1);
+	}
+}
+
+
+//! Allocate int sample buffers
+/*! \param n       Number of samples
+	\return        Buffer (free with free()) */
+static int *alloc_samples(size_t n)
+{
+	int *p = (int *)malloc(MAX(n, 1) * sizeof(int));
+
+	if (p == NULL)
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
+	return (p);
+}
+
+
+//! Convert RGB to YCbCr
+/*! The color space of the output picture selects BT.709 (YUV_HD) or BT.601 (YUV_SD).
+    \param ip      Input picture (pic_t)
     \param op      Output picture (pic_t) */
 void rgb2yuv(pic_t *ip, pic_t *op)
 {
-	fprintf(stderr, "ERROR: RGB to YUV conversion not supported\n");
-	exit(1);
+	csc_t csc;
+	int   *in[3], *out[3], *tmp;
+	int   i, c;
+
+	check_conversion(ip, op, "rgb2yuv");
+	if ((ip->color != RGB) || (op->color == RGB) || (ip->chroma != YUV_444) || (op->chroma != YUV_444))
+	{
+		fprintf(stderr, "ERROR: rgb2yuv() expects RGB 4:4:4 input and YUV 4:4:4 output\n");
+		exit(1);
+	}
+
+	csc_setup(&csc, op->color, 1, ip->bits);
+	tmp = alloc_samples(6 * (size_t)ip->w);
+	for (i = 0; i < ip->h; i++)
+	{
+		for (c = 0; c < 3; c++)
+		{
+			in[c] = prow_get(ip, c, i, tmp + c * ip->w);
+			out[c] = prow_target(op, c, i, tmp + (3 + c) * ip->w);
+		}
+		csc_row(&csc, in, out, ip->w);
+		for (c = 0; c < 3; c++)
+			prow_put(op, c, i, out[c]);
+	}
+	free(tmp);
+	op->bits = ip->bits;
 }
 
 
-//! Convert YCbCr to RGB (unsupported)
-/*! \param ip      Input picture (pic_t)
+//! Convert YCbCr to RGB
+/*! The color space of the input picture selects BT.709 (YUV_HD) or BT.601 (YUV_SD).
+    \param ip      Input picture (pic_t)
     \param op      Output picture (pic_t) */
 void yuv2rgb(pic_t *ip, pic_t *op)
 {
-	fprintf(stderr, "ERROR: YUV to RGB conversion not supported\n");
-	exit(1);
+	csc_t csc;
+	int   *in[3], *out[3], *tmp;
+	int   i, c;
+
+	check_conversion(ip, op, "yuv2rgb");
+	if ((ip->color == RGB) || (op->color != RGB) || (ip->chroma != YUV_444) || (op->chroma != YUV_444))
+	{
+		fprintf(stderr, "ERROR: yuv2rgb() expects YUV 4:4:4 input and RGB 4:4:4 output\n");
+		exit(1);
+	}
+
+	csc_setup(&csc, ip->color, 0, ip->bits);
+	tmp = alloc_samples(6 * (size_t)ip->w);
+	for (i = 0; i < ip->h; i++)
+	{
+		for (c = 0; c < 3; c++)
+		{
+			in[c] = prow_get(ip, c, i, tmp + c * ip->w);
+			out[c] = prow_target(op, c, i, tmp + (3 + c) * ip->w);
+		}
+		csc_row(&csc, in, out, ip->w);
+		for (c = 0; c < 3; c++)
+			prow_put(op, c, i, out[c]);
+	}
+	free(tmp);
+	op->bits = ip->bits;
 }
 
 
-//! Convert YCbCr 4:2:2 to YCbCr 4:4:4 (unsupported)
+//! Convert YCbCr 4:2:2 to YCbCr 4:4:4
 /*! \param ip      Input picture (pic_t)
     \param op      Output picture (pic_t) */
 void yuv_422_444(pic_t *ip, pic_t *op)
 {
-	fprintf(stderr, "ERROR: 422 to 444 conversion not supported.\n");
-	exit(1);
+	int  coeff[256];
+	int *scratch, *in, *out, *d;
+	int  i, c;
+
+	check_conversion(ip, op, "yuv_422_444");
+	if ((ip->color == RGB) || (op->color == RGB) || (ip->chroma != YUV_422) || (op->chroma != YUV_444))
+	{
+		fprintf(stderr, "ERROR: yuv_422_444() expects 4:2:2 input and 4:4:4 output\n");
+		exit(1);
+	}
+
+	fir_setup(&fir_422_444, coeff);
+	scratch = alloc_samples(4 * (size_t)op->w + 2 * fir_422_444.tap);
+	in = scratch + 2 * op->w + 2 * fir_422_444.tap;
+	out = in + op->w;
+	for (i = 0; i < ip->h; i++)
+	{
+		prow_put(op, 0, i, prow_get(ip, 0, i, in));
+		for (c = 1; c < 3; c++)
+		{
+			d = prow_target(op, c, i, out);
+			chroma_up_row(prow_get(ip, c, i, in), ip->w / 2, op->w, coeff, (1 << ip->bits) - 1, scratch, d);
+			prow_put(op, c, i, d);
+		}
+	}
+	free(scratch);
+	op->bits = ip->bits;
 }
 
 
-//! Convert YCbCr 4:4:4 to YCbCr 4:2:2 (unsupported)
+//! Convert YCbCr 4:4:4 to YCbCr 4:2:2
 /*! \param ip      Input picture (pic_t)
     \param op      Output picture (pic_t) */
 void yuv_444_422(pic_t *ip, pic_t *op)
 {
-	fprintf(stderr, "ERROR: 444 to 422 conversion not supported.\n");
-	exit(1);
+	int  coeff[256];
+	int *scratch, *in, *out, *d;
+	int  i, c;
+
+	check_conversion(ip, op, "yuv_444_422");
+	if ((ip->color == RGB) || (op->color == RGB) || (ip->chroma != YUV_444) || (op->chroma != YUV_422))
+	{
+		fprintf(stderr, "ERROR: yuv_444_422() expects 4:4:4 input and 4:2:2 output\n");
+		exit(1);
+	}
+
+	fir_setup(&fir_444_422, coeff);
+	scratch = alloc_samples(4 * (size_t)ip->w + 2 * fir_444_422.tap);
+	in = scratch + 2 * ip->w + 2 * fir_444_422.tap;
+	out = in + ip->w;
+	for (i = 0; i < ip->h; i++)
+	{
+		prow_put(op, 0, i, prow_get(ip, 0, i, in));
+		for (c = 1; c < 3; c++)
+		{
+			d = prow_target(op, c, i, out);
+			chroma_down_row(prow_get(ip, c, i, in), ip->w, op->w / 2, coeff, (1 << ip->bits) - 1, scratch, d);
+			prow_put(op, c, i, d);
+		}
+	}
+	free(scratch);
+	op->bits = ip->bits;
 }
 
 
@@ -256,63 +931,418 @@ void yuv_444_422(pic_t *ip, pic_t *op)
     \param newbits New bit depth */
 void convertbits(pic_t *p, int newbits)
 {
-	int ii, jj;
-	int error = 0;
+	int ii, jj, c, n;
 	int rs = 0, ls = 0;
+	int *tmp, *row;
 
 	if(p->bits > newbits)
 		rs = p->bits - newbits;
 	else
 		ls = newbits - p->bits;
 
-	if (p->color == RGB) {           
-		if (p->chroma == YUV_444) {
-			// RGB 4:4:4
-			for (ii=0; ii<p->h; ++ii) {
-				for (jj=0; jj<p->w; ++jj) {
-					p->data.rgb.r[ii][jj] = (p->data.rgb.r[ii][jj]<<ls)>>rs;
-					p->data.rgb.g[ii][jj] = (p->data.rgb.g[ii][jj]<<ls)>>rs;
-					p->data.rgb.b[ii][jj] = (p->data.rgb.b[ii][jj]<<ls)>>rs;
-					//p->data.rgb.a[ii][jj] = (p->data.rgb.a[ii][jj]<<ls)>>rs;
-				}
+	if ((p->color == RGB) && (p->chroma != YUV_444))
+		printf(" RGB 422 not supported yet.\n");   // we don't handle any RGB that's not 4:4:4 at this point
+	if ((p->chroma != YUV_444) && ((p->color == RGB) || (p->chroma != YUV_422)))
+	{
+		fprintf(stderr, "ERROR: Calling convert8to10() with incompatible format.  Only handle RGB444 or YUV422 or YUV444.\n");
+		exit(1);
+	}
+
+	tmp = alloc_samples(p->w);
+	for (ii=0; ii<p->h; ++ii)
+	{
+		for (c=0; c<3; ++c)
+		{
+			row = prow_get(p, c, ii, tmp);
+			n = plane_width(p, c);
+			for (jj=0; jj<n; ++jj)
+				row[jj] = (row[jj]<<ls)>>rs;
+			prow_put(p, c, ii, row);
+		}
+	}
+	free(tmp);
+	p->bits = newbits;
+}
+
+
+//! Convert an input picture to the format the encoder codes in one pass
+/*! Performs the R/B swap, bit depth change, color space and chroma format conversion
+    and cropping selected by norm row by row, so every source row is read once and
+	written straight into the output picture. Conversions run at the higher of the
+	input and output bit depths, as when the steps are applied to whole pictures.
+	\param ip       Input picture (destroyed)
+	\param norm     Target format
+	\param expanded If not NULL, receives a 4:4:4 copy of a 4:2:2 output made with the
+	                simple422to444() rules in the same pass
+	\return         Normalized picture */
+pic_t *pnormalize(pic_t *ip, const pnorm_t *norm, pic_t **expanded)
+{
+	pic_t *op, *xp = NULL;
+	csc_t  csc;
+	int    up_coeff[256], down_coeff[256];
+	color_t color;
+	int    cw, scw, n, i, j, c;
+	int    wb, ls, rs, maxval;
+	int    up422, down422, convert;
+	int   *work, *scratch, *buf[2][3], *cur[3], *nxt[3], *out[3], *xrow[3];
+	int   *s, *d, *y, *u, *v, *xy, *xu, *xv;
+
+	if ((ip->chroma != YUV_444) && ((ip->chroma != YUV_422) || (ip->color == RGB)))
+	{
+		fprintf(stderr, "ERROR: pnormalize() expects RGB 4:4:4, YUV 4:4:4 or YUV 4:2:2 input\n");
+		exit(1);
+	}
+	if ((norm->w > ip->w) || ((norm->chroma == YUV_422) && (norm->w % 2)))
+	{
+		fprintf(stderr, "ERROR: pnormalize() output width %d is not valid for a %d pixel wide input\n", norm->w, ip->w);
+		exit(1);
+	}
+	if (!norm->yuv && (norm->chroma != YUV_444))
+	{
+		fprintf(stderr, "ERROR: pnormalize() only produces RGB as 4:4:4\n");
+		exit(1);
+	}
+
+	wb = MAX(ip->bits, norm->bits);
+	ls = wb - ip->bits;
+	rs = wb - norm->bits;
+	maxval = (1 << wb) - 1;
+	up422 = (ip->chroma == YUV_422) && (norm->chroma == YUV_444);
+	down422 = (ip->chroma == YUV_444) && (norm->chroma == YUV_422);
+	convert = ((ip->color == RGB) == (norm->yuv != 0));
+	color = norm->yuv ? ((ip->color == RGB) ? YUV_HD : ip->color) : RGB;
+	scw = (ip->chroma == YUV_422) ? ip->w / 2 : ip->w;
+	cw = (norm->chroma == YUV_422) ? norm->w / 2 : norm->w;
+
+	if (convert)
+		csc_setup(&csc, (ip->color == RGB) ? color : ip->color, ip->color == RGB, wb);
+	fir_setup(&fir_422_444, up_coeff);
+	fir_setup(&fir_444_422, down_coeff);
+
+	// Two sets of full-width rows to ping-pong between stages, rows for a 16-bit 4:4:4 copy, plus filter scratch
+	work = alloc_samples(11 * (size_t)ip->w + 2 * 256);
+	for (c = 0; c < 3; c++)
+	{
+		buf[0][c] = work + c * ip->w;
+		buf[1][c] = work + (3 + c) * ip->w;
+		xrow[c] = work + (6 + c) * ip->w;
+	}
+	scratch = work + 9 * ip->w;
+#define OTHER_ROW(c) ((cur[c] == buf[0][c]) ? buf[1][c] : buf[0][c])
+
+	op = (norm->planes16 ? pcreate16 : pcreate)(ip->format, color, norm->chroma, norm->w, ip->h);
+	op->bits = norm->bits;
+	op->alpha = 0;
+	op->ar1 = ip->ar1;
+	op->ar2 = ip->ar2;
+	op->frm_no = ip->frm_no;
+	op->seq_len = ip->seq_len;
+	op->framerate = ip->framerate;
+	op->interlaced = ip->interlaced;
+
+	if (expanded && (norm->chroma == YUV_422))
+	{
+		xp = (norm->planes16 ? pcreate16 : pcreate)(FRAME, color, YUV_444, norm->w, ip->h);
+		xp->bits = norm->bits;
+		xp->alpha = 0;
+	}
+
+	for (i = 0; i < ip->h; i++)
+	{
+		// Each stage writes into whichever work row of the plane it is not reading
+		for (c = 0; c < 3; c++)
+			cur[c] = prow_get(ip, (norm->rb_swap && (ip->color == RGB)) ? 2 - c : c, i, buf[0][c]);
+
+		if (ls)
+		{
+			for (c = 0; c < 3; c++)
+			{
+				d = OTHER_ROW(c);
+				n = c ? scw : ip->w;
+				for (j = 0; j < n; j++)
+					d[j] = cur[c][j] << ls;
+				cur[c] = d;
+			}
+		}
+		if (up422)
+		{
+			for (c = 1; c < 3; c++)
+			{
+				d = OTHER_ROW(c);
+				chroma_up_row(cur[c], scw, ip->w, up_coeff, maxval, scratch, d);
+				cur[c] = d;
+			}
+		}
+		if (convert)
+		{
+			for (c = 0; c < 3; c++)
+				nxt[c] = OTHER_ROW(c);
+			csc_row(&csc, cur, nxt, ip->w);
+			for (c = 0; c < 3; c++)
+				cur[c] = nxt[c];
+		}
+		if (down422)
+		{
+			for (c = 1; c < 3; c++)
+			{
+				d = OTHER_ROW(c);
+				chroma_down_row(cur[c], ip->w, cw, down_coeff, maxval, scratch, d);
+				cur[c] = d;
 			}
-		} else {
-			// we don't handle any RGB that's not 4:4:4 at this point
-			printf(" RGB 422 not supported yet.\n");
-			error = 1;
-		}
-	} else {
-		// YUV format (either SD or HD)
-		if (p->chroma == YUV_444) {
-			// YUV 4:4:4
-			for (ii=0; ii<p->h; ++ii) {
-				for (jj=0; jj<p->w; ++jj) {
-					p->data.yuv.y[ii][jj] = (p->data.yuv.y[ii][jj]<<ls)>>rs;
-					p->data.yuv.u[ii][jj] = (p->data.yuv.u[ii][jj]<<ls)>>rs;
-					p->data.yuv.v[ii][jj] = (p->data.yuv.v[ii][jj]<<ls)>>rs;
+		}
+
+		for (c = 0; c < 3; c++)
+		{
+			s = cur[c];
+			d = out[c] = prow_target(op, c, i, OTHER_ROW(c));
+			n = c ? cw : norm->w;
+			for (j = 0; j < n; j++)
+				d[j] = s[j] >> rs;
+			prow_put(op, c, i, d);
+		}
+
+		if (xp)
+		{
+			// *MODEL NOTE* MN_SIMPLE_422_444
+			y = out[0];
+			u = out[1];
+			v = out[2];
+			xy = prow_target(xp, 0, i, xrow[0]);
+			xu = prow_target(xp, 1, i, xrow[1]);
+			xv = prow_target(xp, 2, i, xrow[2]);
+			memcpy(xy, y, norm->w * sizeof(int));
+			for (j = 0; j < norm->w; j++)
+			{
+				if ((j%2) && (j < norm->w-1))
+				{
+					xu[j] = (u[j/2] + u[j/2+1]) >> 1;
+					xv[j] = (v[j/2] + v[j/2+1]) >> 1;
+				} else {
+					xu[j] = u[j/2];
+					xv[j] = v[j/2];
 				}
 			}
-		} else {
-			if (p->chroma == YUV_422) {
-				for (ii=0; ii<p->h; ++ii) {
-					for (jj=0; jj<(p->w/2); ++jj) {
-						p->data.yuv.u[ii][jj] = (p->data.yuv.u[ii][jj]<<ls)>>rs;
-						p->data.yuv.y[ii][jj*2] = (p->data.yuv.y[ii][jj*2]<<ls)>>rs;
-						p->data.yuv.v[ii][jj] = (p->data.yuv.v[ii][jj]<<ls)>>rs;
-						p->data.yuv.y[ii][jj*2+1] = (p->data.yuv.y[ii][jj*2+1]<<ls)>>rs;
-					}
+			prow_put(xp, 0, i, xy);
+			prow_put(xp, 1, i, xu);
+			prow_put(xp, 2, i, xv);
+		}
+	}
+
+#undef OTHER_ROW
+	free(work);
+	pdestroy(ip);
+	if (expanded)
+		*expanded = xp;
+	return (op);
+}
+
+
+#if defined(__SSE4_1__)
+// ppm_unpack_mask[bps-1][c][v] moves the bytes of component c in source vector v of a
+// 48-byte block of interleaved big-endian samples to little-endian lanes (0x80 clears a lane).
+static const unsigned char ppm_unpack_mask[2][3][3][16] =
+{
+	{	// 8-bit samples
+		{
+			{ 0x00,0x03,0x06,0x09,0x0c,0x0f,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x02,0x05,0x08,0x0b,0x0e,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x01,0x04,0x07,0x0a,0x0d }
+		},
+		{
+			{ 0x01,0x04,0x07,0x0a,0x0d,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x00,0x03,0x06,0x09,0x0c,0x0f,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x02,0x05,0x08,0x0b,0x0e }
+		},
+		{
+			{ 0x02,0x05,0x08,0x0b,0x0e,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x01,0x04,0x07,0x0a,0x0d,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x00,0x03,0x06,0x09,0x0c,0x0f }
+		}
+	},
+	{	// 16-bit samples
+		{
+			{ 0x01,0x00,0x07,0x06,0x0d,0x0c,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x03,0x02,0x09,0x08,0x0f,0x0e,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x05,0x04,0x0b,0x0a }
+		},
+		{
+			{ 0x03,0x02,0x09,0x08,0x0f,0x0e,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x05,0x04,0x0b,0x0a,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x01,0x00,0x07,0x06,0x0d,0x0c }
+		},
+		{
+			{ 0x05,0x04,0x0b,0x0a,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x01,0x00,0x07,0x06,0x0d,0x0c,0x80,0x80,0x80,0x80,0x80,0x80 },
+			{ 0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x03,0x02,0x09,0x08,0x0f,0x0e }
+		}
+	}
+};
+
+// ppm_pack_mask[bps-1][v][c] places the narrowed samples of component c in output vector v
+// of a 48-byte block of interleaved big-endian samples (0x80 clears a lane).
+static const unsigned char ppm_pack_mask[2][3][3][16] =
+{
+	{	// 8-bit samples
+		{
+			{ 0x00,0x80,0x80,0x01,0x80,0x80,0x02,0x80,0x80,0x03,0x80,0x80,0x04,0x80,0x80,0x05 },
+			{ 0x80,0x00,0x80,0x80,0x01,0x80,0x80,0x02,0x80,0x80,0x03,0x80,0x80,0x04,0x80,0x80 },
+			{ 0x80,0x80,0x00,0x80,0x80,0x01,0x80,0x80,0x02,0x80,0x80,0x03,0x80,0x80,0x04,0x80 }
+		},
+		{
+			{ 0x80,0x80,0x06,0x80,0x80,0x07,0x80,0x80,0x08,0x80,0x80,0x09,0x80,0x80,0x0a,0x80 },
+			{ 0x05,0x80,0x80,0x06,0x80,0x80,0x07,0x80,0x80,0x08,0x80,0x80,0x09,0x80,0x80,0x0a },
+			{ 0x80,0x05,0x80,0x80,0x06,0x80,0x80,0x07,0x80,0x80,0x08,0x80,0x80,0x09,0x80,0x80 }
+		},
+		{
+			{ 0x80,0x0b,0x80,0x80,0x0c,0x80,0x80,0x0d,0x80,0x80,0x0e,0x80,0x80,0x0f,0x80,0x80 },
+			{ 0x80,0x80,0x0b,0x80,0x80,0x0c,0x80,0x80,0x0d,0x80,0x80,0x0e,0x80,0x80,0x0f,0x80 },
+			{ 0x0a,0x80,0x80,0x0b,0x80,0x80,0x0c,0x80,0x80,0x0d,0x80,0x80,0x0e,0x80,0x80,0x0f }
+		}
+	},
+	{	// 16-bit samples
+		{
+			{ 0x01,0x00,0x80,0x80,0x80,0x80,0x03,0x02,0x80,0x80,0x80,0x80,0x05,0x04,0x80,0x80 },
+			{ 0x80,0x80,0x01,0x00,0x80,0x80,0x80,0x80,0x03,0x02,0x80,0x80,0x80,0x80,0x05,0x04 },
+			{ 0x80,0x80,0x80,0x80,0x01,0x00,0x80,0x80,0x80,0x80,0x03,0x02,0x80,0x80,0x80,0x80 }
+		},
+		{
+			{ 0x80,0x80,0x07,0x06,0x80,0x80,0x80,0x80,0x09,0x08,0x80,0x80,0x80,0x80,0x0b,0x0a },
+			{ 0x80,0x80,0x80,0x80,0x07,0x06,0x80,0x80,0x80,0x80,0x09,0x08,0x80,0x80,0x80,0x80 },
+			{ 0x05,0x04,0x80,0x80,0x80,0x80,0x07,0x06,0x80,0x80,0x80,0x80,0x09,0x08,0x80,0x80 }
+		},
+		{
+			{ 0x80,0x80,0x80,0x80,0x0d,0x0c,0x80,0x80,0x80,0x80,0x0f,0x0e,0x80,0x80,0x80,0x80 },
+			{ 0x0b,0x0a,0x80,0x80,0x80,0x80,0x0d,0x0c,0x80,0x80,0x80,0x80,0x0f,0x0e,0x80,0x80 },
+			{ 0x80,0x80,0x0b,0x0a,0x80,0x80,0x80,0x80,0x0d,0x0c,0x80,0x80,0x80,0x80,0x0f,0x0e }
+		}
+	}
+};
+#endif
+
+
+//! Split one row of interleaved big-endian PPM samples into planes
+/*! \param src     Raster row (w samples of ncomp components, bps bytes each)
+	\param w       Number of pixels
+	\param ncomp   Components per pixel (3 for P6, 1 for P5)
+	\param bps     Bytes per sample (1 or 2)
+	\param out     Output rows (out[0] only when ncomp is 1) */
+static void ppm_unpack_row(const unsigned char *src, int w, int ncomp, int bps, int *const out[3])
+{
+	int j = 0, c;
+
+#if defined(__SSE4_1__)
+	if (ncomp == 3)
+	{
+		// Each block of 48 source bytes yields 16 (8-bit) or 8 (16-bit) samples per component.
+		__m128i m[3][3], v[3], x;
+		int spb = 16 / bps;     // Pixels per 48-byte block
+		int k, t;
+
+		for (c = 0; c < 3; c++)
+			for (k = 0; k < 3; k++)
+				m[c][k] = _mm_loadu_si128((const __m128i *)ppm_unpack_mask[bps-1][c][k]);
+
+		for (; j + spb <= w; j += spb, src += 48)
+		{
+			for (k = 0; k < 3; k++)
+				v[k] = _mm_loadu_si128((const __m128i *)(src + 16 * k));
+			for (c = 0; c < 3; c++)
+			{
+				x = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v[0], m[c][0]), _mm_shuffle_epi8(v[1], m[c][1])), _mm_shuffle_epi8(v[2], m[c][2]));
+				for (t = 0; t < spb; t += 4)
+				{
+					_mm_storeu_si128((__m128i *)(out[c] + j + t), (bps == 1) ? _mm_cvtepu8_epi32(x) : _mm_cvtepu16_epi32(x));
+					x = (bps == 1) ? _mm_srli_si128(x, 4) : _mm_srli_si128(x, 8);
 				}
-			} else {
-				error = 1;
 			}
 		}
 	}
+	else
+	{
+		__m128i bs = _mm_setr_epi8(1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14);
+		__m128i x;
+		int t;
 
-	if (error) {
-		fprintf(stderr, "ERROR: Calling convert8to10() with incompatible format.  Only handle RGB444 or YUV422 or YUV444.\n");
-		exit(1);
+		for (; j + 16 / bps <= w; j += 16 / bps, src += 16)
+		{
+			x = _mm_loadu_si128((const __m128i *)src);
+			if (bps == 2)
+				x = _mm_shuffle_epi8(x, bs);
+			for (t = 0; t < 16 / bps; t += 4)
+			{
+				_mm_storeu_si128((__m128i *)(out[0] + j + t), (bps == 1) ? _mm_cvtepu8_epi32(x) : _mm_cvtepu16_epi32(x));
+				x = (bps == 1) ? _mm_srli_si128(x, 4) : _mm_srli_si128(x, 8);
+			}
+		}
+	}
+#endif
+	for (; j < w; j++)
+	{
+		for (c = 0; c < ncomp; c++, src += bps)
+			out[c][j] = (bps == 1) ? src[0] : (src[0] << 8) + src[1];
+	}
+}
+
+
+//! Interleave one row of planes into big-endian PPM samples
+/*! Each sample is truncated to bps bytes, as fputc() of its low bytes would.
+    \param in      Input rows (r, g, b)
+	\param w       Number of pixels
+	\param bps     Bytes per sample (1 or 2)
+	\param dst     Raster row (w pixels of 3 samples) */
+static void ppm_pack_row(int *const in[3], int w, int bps, unsigned char *dst)
+{
+	int j = 0, c;
+
+#if defined(__SSE4_1__)
+	{
+		// Samples of each component are first narrowed to bytes (8-bit) or little-endian
+		// 16-bit lanes, then ppm_pack_mask places them in the output vectors.
+		__m128i m[3][3], s[3], o;
+		__m128i n8 = _mm_setr_epi8(0,4,8,12, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1);
+		__m128i n16 = _mm_setr_epi8(0,1,4,5,8,9,12,13, -1,-1,-1,-1, -1,-1,-1,-1);
+		int spb = 16 / bps;     // Pixels per 48-byte block
+		int k, i;
+
+		for (k = 0; k < 3; k++)
+			for (c = 0; c < 3; c++)
+				m[k][c] = _mm_loadu_si128((const __m128i *)ppm_pack_mask[bps-1][k][c]);
+
+		for (; j + spb <= w; j += spb, dst += 48)
+		{
+			for (c = 0; c < 3; c++)
+			{
+				if (bps == 1)
+				{
+					__m128i q[4];
+
+					for (i = 0; i < 4; i++)
+						q[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in[c] + j + 4 * i)), n8);
+					s[c] = _mm_unpacklo_epi64(_mm_unpacklo_epi32(q[0], q[1]), _mm_unpacklo_epi32(q[2], q[3]));
+				}
+				else
+				{
+					s[c] = _mm_unpacklo_epi64(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in[c] + j)), n16),
+					                          _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in[c] + j + 4)), n16));
+				}
+			}
+			for (k = 0; k < 3; k++)
+			{
+				o = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(s[0], m[k][0]), _mm_shuffle_epi8(s[1], m[k][1])), _mm_shuffle_epi8(s[2], m[k][2]));
+				_mm_storeu_si128((__m128i *)(dst + 16 * k), o);
+			}
+		}
+	}
+#endif
+	for (; j < w; j++)
+	{
+		for (c = 0; c < 3; c++)
+		{
+			if (bps > 1)
+				*dst++ = (unsigned char)(in[c][j] >> 8);
+			*dst++ = (unsigned char)in[c][j];
+		}
 	}
-	p->bits = newbits;
 }
 
 
@@ -331,6 +1361,10 @@ pic_t *readppm(FILE *fp)
 	int i, j;
 	int r, g, b;
 	int maxval;
+	int ncomp, bps;
+	size_t row, n;
+	unsigned char *raster;
+	int *out[3], *tmp;
 
 	fgets(line, 1000, fp);
 	sscanf(line, "%s", magicnum);
@@ -364,7 +1398,7 @@ pic_t *readppm(FILE *fp)
 		}
 	}
 
-	p = pcreate(FRAME, RGB, YUV_444, w, h);
+	p = pcreate16(FRAME, RGB, YUV_444, w, h);   // PPM samples have at most 16 bits
 	if (maxval <= 255)
 		p->bits = 8;
 	else if (maxval <= 1023)
@@ -380,53 +1414,63 @@ pic_t *readppm(FILE *fp)
 		return(NULL);
 	}
 
+	tmp = alloc_samples(3 * (size_t)w);
+	for (i = 0; i < 3; i++)
+		out[i] = tmp + i * w;
 	if (magicnum[1] == '2')
 		for (i = 0; i < h; i++)
+		{
 			for (j = 0; j < w; j++)
 			{
 				fscanf(fp, "%d", &g);  // Gray value in PGM
-				p->data.rgb.r[i][j] = g;
-				p->data.rgb.g[i][j] = g;
-				p->data.rgb.b[i][j] = g;
+				out[0][j] = g;
+				out[1][j] = g;
+				out[2][j] = g;
 			}
+			prow_put(p, 0, i, out[0]);
+			prow_put(p, 1, i, out[1]);
+			prow_put(p, 2, i, out[2]);
+		}
 	else if (magicnum[1] == '3')
 		for (i = 0; i < h; i++)
+		{
 			for (j = 0; j < w; j++)
 			{
 				fscanf(fp, "%d %d %d", &r, &g, &b);
-				p->data.rgb.r[i][j] = r;
-				p->data.rgb.g[i][j] = g;
-				p->data.rgb.b[i][j] = b;
-			}
-	else if (magicnum[1] == '5') // PGM binary
-		for (i = 0; i < h; i++)
-			for (j = 0; j < w; j++)
-			{
-				g = (unsigned char)fgetc(fp);  // Gray value
-				if(maxval > 255)
-					g = (g<<8) + (unsigned char)fgetc(fp);
-				p->data.rgb.r[i][j] = g;
-				p->data.rgb.g[i][j] = g;
-				p->data.rgb.b[i][j] = g;
+				out[0][j] = r;
+				out[1][j] = g;
+				out[2][j] = b;
 			}
-	else // P6
+			prow_put(p, 0, i, out[0]);
+			prow_put(p, 1, i, out[1]);
+			prow_put(p, 2, i, out[2]);
+		}
+	else // P5 (PGM binary) or P6
 	{
+		// Read the whole raster at once, then split it into planes row by row
+		ncomp = (magicnum[1] == '5') ? 1 : 3;
+		bps = (maxval > 255) ? 2 : 1;
+		row = (size_t)w * ncomp * bps;
+		raster = (unsigned char *)malloc(MAX(row * h, 1));
+		if (raster == NULL)
+		{
+			fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+			exit(1);
+		}
+		n = fread(raster, 1, row * h, fp);
+		if (n < row * h)
+			memset(raster + n, 0xff, row * h - n);   // Missing samples read as all ones, as fgetc() returning EOF did
+
 		for (i = 0; i < h; i++)
 		{
-			for (j = 0; j < w; j++)
-			{
-				p->data.rgb.r[i][j] = (unsigned char) fgetc(fp);
-				if (maxval > 255)
-					p->data.rgb.r[i][j] = (p->data.rgb.r[i][j] << 8) + (unsigned char)fgetc(fp);
-				p->data.rgb.g[i][j] = (unsigned char) fgetc(fp);
-				if (maxval > 255)
-					p->data.rgb.g[i][j] = (p->data.rgb.g[i][j] << 8) + (unsigned char)fgetc(fp);
-				p->data.rgb.b[i][j] = (unsigned char) fgetc(fp);
-				if (maxval > 255)
-					p->data.rgb.b[i][j] = (p->data.rgb.b[i][j] << 8) + (unsigned char)fgetc(fp);
-			}
+			ppm_unpack_row(raster + row * i, w, ncomp, bps, out);
+			prow_put(p, 0, i, out[0]);
+			prow_put(p, 1, i, out[ncomp == 1 ? 0 : 1]);   // Gray value for P5
+			prow_put(p, 2, i, out[ncomp == 1 ? 0 : 2]);
 		}
+		free(raster);
 	}
+	free(tmp);
 
 	return p;
 }
@@ -457,7 +1501,11 @@ int ppm_read(char *fname, pic_t **pic)
     \param p       Picture to write */
 void writeppm(FILE *fp, pic_t *p)
 {
-	int i, j;
+	int i;
+	int bps = (p->bits > 8) ? 2 : 1;
+	size_t row = (size_t)p->w * 3 * bps;
+	unsigned char *raster;
+	int *in[3], *tmp;
 
 	fprintf(fp, "P6\n");
 	fprintf(fp, "%d %d\n", p->w, p->h);
@@ -473,19 +1521,24 @@ void writeppm(FILE *fp, pic_t *p)
 		exit(1);
 	}
 
+	// Interleave the planes row by row into one raster and write it at once
+	raster = (unsigned char *)malloc(MAX(row * p->h, 1));
+	if (raster == NULL)
+	{
+		fprintf(stderr, "ERROR: Failed to allocate memory.\n");
+		exit(1);
+	}
+	tmp = alloc_samples(3 * (size_t)p->w);
 	for (i = 0; i < p->h; i++)
-		for (j = 0; j < p->w; j++)
-		{
-			if (p->bits>8)
-				fputc((unsigned char)(p->data.rgb.r[i][j] >> 8), fp);
-			fputc((unsigned char) p->data.rgb.r[i][j] & 0xff, fp);
-			if (p->bits>8)
-				fputc((unsigned char)(p->data.rgb.g[i][j] >> 8), fp);
-			fputc((unsigned char) p->data.rgb.g[i][j] & 0xff, fp);
-			if (p->bits>8)
-				fputc((unsigned char)(p->data.rgb.b[i][j] >> 8), fp);
-			fputc((unsigned char) p->data.rgb.b[i][j] & 0xff, fp);
-		}
+	{
+		in[0] = prow_get(p, 0, i, tmp);
+		in[1] = prow_get(p, 1, i, tmp + p->w);
+		in[2] = prow_get(p, 2, i, tmp + 2 * p->w);
+		ppm_pack_row(in, p->w, bps, raster + row * i);
+	}
+	fwrite(raster, 1, row * p->h, fp);
+	free(tmp);
+	free(raster);
 }
 
 
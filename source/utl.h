@@ -49,8 +49,16 @@
 #include "vdo.h"
 
 void *palloc(int w, int h);
+void pfree(void *p);
 pic_t *pcreate(int format, int color, int chroma, int w, int h);
+pic_t *pcreate16(int format, int color, int chroma, int w, int h);
 void *pdestroy(pic_t *p);
+void ppool_init(int max_pics);
+void ppool_free(void);
+int *prow_get(pic_t *p, int c, int y, int *tmp);
+int *prow_target(pic_t *p, int c, int y, int *tmp);
+void prow_put(pic_t *p, int c, int y, const int *row);
+void pswap_planes(pic_t *p, int c0, int c1);
 
 void yuv_444_422(pic_t *ip, pic_t *op);
 void yuv_422_444(pic_t *ip, pic_t *op);
@@ -58,6 +66,18 @@ void rgb2yuv(pic_t *ip, pic_t *op);
 void yuv2rgb(pic_t *ip, pic_t *op);
 
 void convertbits(pic_t *p, int newbits);
+
+//! Target format of pnormalize()
+typedef struct pnorm_s {
+	int      rb_swap;   ///< Swap the R and B components of an RGB input
+	int      bits;      ///< Bit depth of the output
+	int      yuv;       ///< Output YCbCr (1) or RGB (0)
+	chroma_t chroma;    ///< Chroma format of the output (YUV_444 or YUV_422)
+	int      w;         ///< Width of the output (the input is cropped on the right if narrower)
+	int      planes16;  ///< Store the output with 16-bit samples (see pcreate16())
+} pnorm_t;
+
+pic_t *pnormalize(pic_t *ip, const pnorm_t *norm, pic_t **expanded);
 int ppm_read(char *fname, pic_t **pic);
 int ppm_write(char *fname, pic_t *pic);
 
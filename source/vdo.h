@@ -97,6 +97,10 @@ typedef struct pic_s {
     int      seq_len; // num images in sequence
     float    framerate;
     int      interlaced; // prog(0) or int(1) content
+    int      sample_bytes; // bytes per stored sample: sizeof(int), or 2 for 16-bit planes (which have no row view in data)
+    int      stride[3];    // samples from one row to the next in each plane (r/g/b or y/u/v)
+    int      plane_h[3];   // rows allocated in each plane
+    void    *plane[3];     // contiguous, aligned storage of each plane
 
     union data_u {
         rgb_t rgb;
@@ -105,6 +109,9 @@ typedef struct pic_s {
 
 } pic_t;
 
+// Row y of plane c of a picture created with pcreate16()
+#define PIC_ROW16(p, c, y) ((unsigned short *)(p)->plane[c] + (size_t)(y) * (p)->stride[c])
+
 typedef struct pix_s {
     int r; // R or V
     int g; // G or Y